@@ -1,6 +1,8 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <atomic>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -13,5 +15,50 @@ int  arg_to_int_or(const char* s, int fallback);
 // Crea un vector con n elementos inicializados en v.
 std::vector<int> make_vec(int n, int v);
 
-#endif // UTILS_H
+// Duerme mientras *addr == expected (futex privado; puede volver sin aviso).
+void futex_wait(std::atomic<int>* addr, int expected);
+
+// Despierta hasta n hilos dormidos en addr.
+void futex_wake(std::atomic<int>* addr, int n);
+
+// ===== Planificador work-stealing =====
+
+struct WsState; // detalles en utils.cpp
+
+// Pool de `workers` hilos con un deque Chase-Lev por hilo. El hilo que llama
+// a parallel_for participa como worker 0; los demás quedan dormidos entre
+// trabajos. Un worker sin tareas roba la mitad superior de un rango ajeno.
+class WsPool {
+public:
+    explicit WsPool(int workers);
+    ~WsPool();
+    WsPool(const WsPool&) = delete;
+    WsPool& operator=(const WsPool&) = delete;
 
+    int size() const;
+
+    // Ejecuta body(lo, hi, worker) sobre [begin, end) en trozos de a lo más
+    // `grain` elementos. Retorna cuando se procesó todo el rango.
+    void parallel_for(long begin, long end, long grain,
+                      const std::function<void(long, long, int)>& body);
+
+    // Reduce chunk(lo, hi) -> T sobre [begin, end) combinando con op.
+    // Cada worker acumula en su propio slot (una línea de caché) y se
+    // combinan al final, como en la versión sharded de p1.
+    template <class T, class F, class Op>
+    T parallel_reduce(long begin, long end, long grain, T identity, F chunk, Op op) {
+        struct alignas(64) Slot { T v; };
+        std::vector<Slot> part(size(), Slot{identity});
+        parallel_for(begin, end, grain, [&](long lo, long hi, int w) {
+            part[w].v = op(part[w].v, chunk(lo, hi));
+        });
+        T acc = identity;
+        for (auto& s : part) acc = op(acc, s.v);
+        return acc;
+    }
+
+private:
+    WsState* st_;
+};
+
+#endif // UTILS_H
@@ -1,5 +1,5 @@
 #!/usr/bin/env python3
-import subprocess, sys, csv, time, re
+import subprocess, sys, csv, time, re, os, argparse
 from pathlib import Path
 
 ROOT = Path(__file__).resolve().parents[1]
@@ -21,7 +21,7 @@ def median(xs):
 
 # ---------- P1: counter ----------
 
-_rx_p1 = re.compile(r"Resumen \(ms\):\s*naive=([\d\.]+)\s+mutex=([\d\.]+)\s+sharded=([\d\.]+)\s+atomic=([\d\.]+)")
+_rx_p1 = re.compile(r"Resumen \(ms\):\s*naive=([\d\.]+)\s+mutex=([\d\.]+)\s+sharded=([\d\.]+)\s+atomic=([\d\.]+)(?:\s+ws=([\d\.]+))?")
 
 def parse_p1(stdout):
     m = None
@@ -30,13 +30,16 @@ def parse_p1(stdout):
         if m: break
     if not m:
         raise RuntimeError("No encontré la línea de resumen en la salida de p1_counter")
-    naive, mutex, sharded, atomic = map(float, m.groups())
-    return {"naive_ms":naive, "mutex_ms":mutex, "sharded_ms":sharded, "atomic_ms":atomic}
+    naive, mutex, sharded, atomic = map(float, m.groups()[:4])
+    r = {"naive_ms":naive, "mutex_ms":mutex, "sharded_ms":sharded, "atomic_ms":atomic}
+    if m.group(5) is not None:
+        r["ws_ms"] = float(m.group(5))
+    return r
 
 def bench_p1(iters=1_000_000, threads_list=(1,2,4,8), reps=3):
     rows = []
     for T in threads_list:
-        vals = {"naive_ms":[], "mutex_ms":[], "sharded_ms":[], "atomic_ms":[]}
+        vals = {"naive_ms":[], "mutex_ms":[], "sharded_ms":[], "atomic_ms":[], "ws_ms":[]}
         for _ in range(reps):
             code, out = run([str(BIN/"p1_counter"), str(T), str(iters)])
             if code != 0:
@@ -45,12 +48,12 @@ def bench_p1(iters=1_000_000, threads_list=(1,2,4,8), reps=3):
             r = parse_p1(out)
             for k,v in r.items(): vals[k].append(v)
         row = {"threads":T}
-        for k in vals: row[k] = round(median(vals[k]), 4)
+        for k in vals: row[k] = round(median(vals[k]), 4) if vals[k] else ""
         rows.append(row)
 
     csv_path = OUT/"p1_times.csv"
     with open(csv_path, "w", newline="") as f:
-        w = csv.DictWriter(f, fieldnames=["threads","naive_ms","mutex_ms","sharded_ms","atomic_ms"])
+        w = csv.DictWriter(f, fieldnames=["threads","naive_ms","mutex_ms","sharded_ms","atomic_ms","ws_ms"])
         w.writeheader(); w.writerows(rows)
     print(f"[OK] Guardado {csv_path}")
     return rows
@@ -96,12 +99,268 @@ def bench_p5(messages_list=(20000, 50000), buffer_list=(8,16,32,64,128), pause_u
     print(f"[OK] Guardado {csv_path}")
     return rows
 
+# ---------- Sweep de escalabilidad + USL ----------
+#
+# Ley Universal de Escalabilidad (Gunther):
+#     X(N) = lambda*N / (1 + sigma*(N-1) + kappa*N*(N-1))
+# sigma = contención (serialización), kappa = coherencia (coste cruzado).
+# Con C(N) = X(N)/X(1) queda lineal sin intercepto:
+#     N/C(N) - 1 = sigma*(N-1) + kappa*N*(N-1)
+
+# Estrategias que el sweep espera en la salida de cada programa; si falta
+# alguna el sweep falla en vez de sacarla en silencio del ajuste y del gate.
+# approx corre con los K y D por defecto de p1_counter.
+P1_STRATEGIES = ("naive", "mutex", "sharded", "atomic", "ws", "approx")
+P3_STRATEGIES = ("mutex", "rwlock", "striped", "optimistic")
+# naive es el contador con carrera: su tiempo no mide una estrategia correcta,
+# queda en el CSV como referencia pero no se ajusta ni entra al gate
+NOT_GATED = {("p1", "naive")}
+
+_rx_p3 = re.compile(r"\[(MUTEX|RWLOCK|STRIPED|OPTIMISTIC)\]\s*\n\s*valor final=.*?ops/s=(\d+)")
+
+_rx_p1_summary = re.compile(r"Resumen \(ms\):(.*)")
+_rx_kv = re.compile(r"(\w+)=([\d\.]+)")
+
+def parse_p1_summary(stdout):
+    """Todas las estrategias de la línea 'Resumen (ms):' de p1, en ms."""
+    for line in stdout.splitlines()[::-1]:
+        m = _rx_p1_summary.search(line)
+        if m: return {k: float(v) for k, v in _rx_kv.findall(m.group(1))}
+    raise RuntimeError("No encontré la línea de resumen en la salida de p1_counter")
+
+def require_strategies(found, expected, prog):
+    missing = [s for s in expected if s not in found]
+    if missing:
+        raise RuntimeError(f"{prog}: faltan estrategias en la salida: {', '.join(missing)}")
+
+def parse_p3(stdout):
+    r = {tag.lower(): float(ops) for tag, ops in _rx_p3.findall(stdout)}
+    if not r:
+        raise RuntimeError("No encontré resultados en la salida de p3_rw")
+    return r
+
+def mad(xs):
+    # desviación absoluta mediana, escalada para estimar sigma con ruido normal
+    m = median(xs)
+    return 1.4826 * median([abs(x - m) for x in xs])
+
+def sweep(max_threads, reps=5, iters=1_000_000, p3_args=(25, 200000, 64, 8, "uniform")):
+    """Throughput (ops/s) de cada estrategia de p1 y p3 para T = 1..max_threads."""
+    samples = {}  # (bench, strategy, T) -> [ops/s]
+    for T in range(1, max_threads + 1):
+        for _ in range(reps):
+            code, out = run([str(BIN/"p1_counter"), str(T), str(iters)])
+            if code != 0:
+                print(out); raise RuntimeError("p1_counter falló")
+            summary = parse_p1_summary(out)
+            require_strategies(summary, P1_STRATEGIES, "p1_counter")
+            for k in P1_STRATEGIES:
+                v = summary[k]
+                ops = T * iters / (v / 1000.0) if v > 0 else 0.0
+                samples.setdefault(("p1", k, T), []).append(ops)
+
+            code, out = run([str(BIN/"p3_rw"), str(T)] + [str(a) for a in p3_args])
+            if code != 0:
+                print(out); raise RuntimeError("p3_rw falló")
+            r = parse_p3(out)
+            require_strategies(r, P3_STRATEGIES, "p3_rw")
+            for k in P3_STRATEGIES:
+                samples.setdefault(("p3", k, T), []).append(r[k])
+        print(f"  T={T} listo")
+
+    rows = []
+    for (bench, strat, T), xs in sorted(samples.items()):
+        rows.append({"bench": bench, "strategy": strat, "threads": T,
+                     "ops_s": round(median(xs), 1), "mad": round(mad(xs), 1), "reps": len(xs)})
+    return rows
+
+def _solve2(a11, a12, a22, b1, b2):
+    det = a11*a22 - a12*a12
+    if abs(det) < 1e-12: return None
+    return ((b1*a22 - a12*b2) / det, (a11*b2 - a12*b1) / det)
+
+def fit_usl(points):
+    """points: [(N, X)] con N=1 incluido. Retorna dict con lambda, sigma, kappa, r2."""
+    pts = sorted(points)
+    if len(pts) < 3 or pts[0][0] != 1 or pts[0][1] <= 0:
+        return None
+    lam = pts[0][1]
+    xs1, xs2, ys = [], [], []
+    for n, x in pts[1:]:
+        if x <= 0: continue
+        xs1.append(n - 1); xs2.append(n * (n - 1)); ys.append(n / (x / lam) - 1)
+    if len(ys) < 2: return None
+
+    # mínimos cuadrados sin intercepto; si un coeficiente sale negativo se fija
+    # en 0 y se ajusta el otro solo (ambos deben ser >= 0 físicamente)
+    s11 = sum(a*a for a in xs1); s22 = sum(b*b for b in xs2); s12 = sum(a*b for a, b in zip(xs1, xs2))
+    t1 = sum(a*y for a, y in zip(xs1, ys)); t2 = sum(b*y for b, y in zip(xs2, ys))
+    sol = _solve2(s11, s12, s22, t1, t2)
+    sigma, kappa = sol if sol else (t1 / s11, 0.0)
+    if kappa < 0:
+        kappa = 0.0; sigma = t1 / s11
+    if sigma < 0:
+        sigma = 0.0; kappa = max(0.0, t2 / s22)
+
+    def model(n): return lam * n / (1 + sigma*(n - 1) + kappa*n*(n - 1))
+    mean_x = sum(x for _, x in pts) / len(pts)
+    ss_res = sum((x - model(n))**2 for n, x in pts)
+    ss_tot = sum((x - mean_x)**2 for _, x in pts)
+    r2 = 1 - ss_res/ss_tot if ss_tot > 0 else 1.0
+    n_peak = ((1 - sigma) / kappa) ** 0.5 if kappa > 0 and sigma < 1 else float("inf")
+    return {"lambda": lam, "sigma": sigma, "kappa": kappa, "n_peak": n_peak, "r2": r2}
+
+def write_csv(path, rows, fields):
+    with open(path, "w", newline="") as f:
+        w = csv.DictWriter(f, fieldnames=fields)
+        w.writeheader(); w.writerows(rows)
+    print(f"[OK] Guardado {path}")
+
+def read_sweep_csv(path):
+    out = {}
+    with open(path, newline="") as f:
+        for r in csv.DictReader(f):
+            out[(r["bench"], r["strategy"], int(r["threads"]))] = (float(r["ops_s"]), float(r["mad"]))
+    return out
+
+def usl_rows(rows):
+    groups = {}
+    for r in rows:
+        if (r["bench"], r["strategy"]) in NOT_GATED: continue
+        groups.setdefault((r["bench"], r["strategy"]), []).append((r["threads"], r["ops_s"]))
+    out = []
+    for (bench, strat), pts in sorted(groups.items()):
+        fit = fit_usl(pts)
+        if fit is None:
+            print(f"[WARN] {bench}/{strat}: hacen falta >= 3 puntos (T=1..3) para ajustar USL")
+            continue
+        out.append({"bench": bench, "strategy": strat,
+                    "lambda": round(fit["lambda"], 1), "sigma": round(fit["sigma"], 6),
+                    "kappa": round(fit["kappa"], 6), "n_peak": round(fit["n_peak"], 2),
+                    "r2": round(fit["r2"], 4)})
+    return out
+
+def compare_baseline(current, baseline, min_drop_pct=5.0, noise_k=3.0):
+    """Falla si alguna caída de throughput supera max(min_drop_pct, noise_k * ruido).
+
+    El ruido de cada punto es sqrt(mad_base^2 + mad_cur^2) relativo al baseline,
+    así los puntos ruidosos toleran más y los estables detectan caídas chicas.
+    Un punto del baseline que falta en el sweep actual también cuenta como falla.
+    """
+    failures = []
+    for key, (base, base_mad) in sorted(baseline.items()):
+        if key[:2] in NOT_GATED or base <= 0: continue
+        if key not in current:
+            print(f"  {key[0]}/{key[1]:<10} T={key[2]:<3} base={base:>14.0f} actual={'-':>14}  FALTA")
+            failures.append(key)
+            continue
+        cur, cur_mad = current[key]
+        drop_pct = 100.0 * (base - cur) / base
+        noise_pct = 100.0 * (base_mad**2 + cur_mad**2) ** 0.5 / base
+        limit = max(min_drop_pct, noise_k * noise_pct)
+        status = "REGRESION" if drop_pct > limit else "ok"
+        print(f"  {key[0]}/{key[1]:<10} T={key[2]:<3} base={base:>14.0f} actual={cur:>14.0f}"
+              f"  caída={drop_pct:6.2f}%  límite={limit:5.2f}%  {status}")
+        if drop_pct > limit: failures.append(key)
+    return failures
+
+# ---------- P3: almacén con K claves (ops/s vs K y S) ----------
+def bench_p3_keys(threads, keys=(1, 16, 256, 4096), stripes=(1, 4, 16, 64),
+                  dists=("uniform", "zipf"), writers_pct=25, ops=200000, reps=3):
+    """Grilla K x S x distribución de p3; S > K no aporta y se omite."""
+    rows = []
+    for dist in dists:
+        for K in keys:
+            for S in stripes:
+                if S > K and S != stripes[0]: continue
+                vals = {}
+                for _ in range(reps):
+                    code, out = run([str(BIN/"p3_rw"), str(threads), str(writers_pct), str(ops),
+                                     str(K), str(S), dist])
+                    if code != 0:
+                        print(out); raise RuntimeError("p3_rw falló")
+                    for k, v in parse_p3(out).items(): vals.setdefault(k, []).append(v)
+                for strat in P3_STRATEGIES:
+                    rows.append({"threads": threads, "dist": dist, "K": K, "S": S, "strategy": strat,
+                                 "ops_s": round(median(vals.get(strat, [0])), 1)})
+                best = max(P3_STRATEGIES, key=lambda k: median(vals.get(k, [0])))
+                print(f"  {dist:<7} K={K:<5} S={S:<3} mejor={best}")
+    write_csv(OUT/"p3_keys.csv", rows, ["threads", "dist", "K", "S", "strategy", "ops_s"])
+    return rows
+
+def plot_p3_keys(rows):
+    import matplotlib.pyplot as plt
+    S0 = min(r["S"] for r in rows)
+    for dist in sorted({r["dist"] for r in rows}):
+        plt.figure()
+        # striped: una curva por S; el resto no depende de S y va con S mínimo
+        lines = [(f"striped S={S}", "striped", S) for S in sorted({r["S"] for r in rows})]
+        lines += [(strat, strat, S0) for strat in P3_STRATEGIES if strat != "striped"]
+        for label, strat, S in lines:
+            sub = sorted([r for r in rows if r["dist"] == dist and r["strategy"] == strat and r["S"] == S],
+                         key=lambda r: r["K"])
+            plt.plot([r["K"] for r in sub], [r["ops_s"] for r in sub], marker="o", label=label)
+        plt.xscale("log")
+        plt.xlabel("Claves (K)")
+        plt.ylabel("Throughput (ops/s)")
+        plt.title(f"Práctica 3 — ops/s vs K ({dist})")
+        plt.grid(True); plt.legend()
+        fig_path = FIGS/f"p3_keys_{dist}.png"
+        plt.savefig(fig_path, dpi=160, bbox_inches="tight")
+        plt.close()
+        print(f"[OK] Figura {fig_path}")
+
+# ---------- P1: contador aproximado (throughput vs staleness) ----------
+_rx_p1_approx = re.compile(r"\[APPROX\].*?tiempo=([\d\.]+) ms\s*\n\s*staleness \(cuentas\): "
+                           r"muestras=(\d+)\s+prom=([\d\.]+)\s+p99=(\d+)\s+max=(\d+)")
+
+def bench_staleness(threads, iters=2_000_000, ks=(1, 64, 1024, 16384, 262144), ds_us=(10, 100, 1000, 0), reps=3):
+    """Grilla K x D del modo APPROX de p1; D=0 publica solo por cuenta."""
+    rows = []
+    for K in ks:
+        for D in ds_us:
+            t, avg, p99, mx = [], [], [], []
+            for _ in range(reps):
+                code, out = run([str(BIN/"p1_counter"), str(threads), str(iters), "0", str(K), str(D)])
+                m = _rx_p1_approx.search(out)
+                if code != 0 or not m:
+                    print(out); raise RuntimeError("p1_counter (approx) falló")
+                t.append(float(m.group(1))); avg.append(float(m.group(3)))
+                p99.append(int(m.group(4))); mx.append(int(m.group(5)))
+            ms = median(t)
+            rows.append({"threads": threads, "K": K, "D_us": D,
+                         "ops_s": round(threads * iters / (ms / 1000.0), 1),
+                         "stale_avg": round(median(avg), 1), "stale_p99": median(p99),
+                         "stale_max": max(mx)})
+            print(f"  K={K:<7} D={D:<5}us  ops/s={rows[-1]['ops_s']:>14.0f}  staleness p99={rows[-1]['stale_p99']}")
+    write_csv(OUT/"p1_staleness.csv", rows,
+              ["threads", "K", "D_us", "ops_s", "stale_avg", "stale_p99", "stale_max"])
+    return rows
+
+def plot_staleness(rows):
+    import matplotlib.pyplot as plt
+    plt.figure()
+    for D in sorted({r["D_us"] for r in rows}):
+        sub = sorted([r for r in rows if r["D_us"] == D], key=lambda r: r["K"])
+        plt.plot([max(r["stale_p99"], 1) for r in sub], [r["ops_s"] for r in sub], marker="o",
+                 label=f"D={D} us" if D else "solo K")
+    plt.xscale("log")
+    plt.xlabel("Staleness p99 (cuentas)")
+    plt.ylabel("Throughput (ops/s)")
+    plt.title("Práctica 1 — Contador aproximado: throughput vs staleness")
+    plt.grid(True); plt.legend()
+    fig_path = FIGS/"p1_approx_staleness.png"
+    plt.savefig(fig_path, dpi=160, bbox_inches="tight")
+    plt.close()
+    print(f"[OK] Figura {fig_path}")
+
 # ---------- plots ----------
 def plot_p1(rows):
     import matplotlib.pyplot as plt
     xs = [r["threads"] for r in rows]
-    for key,label in [("naive_ms","Naive"), ("mutex_ms","Mutex"), ("sharded_ms","Sharded"), ("atomic_ms","Atomic")]:
+    for key,label in [("naive_ms","Naive"), ("mutex_ms","Mutex"), ("sharded_ms","Sharded"), ("atomic_ms","Atomic"), ("ws_ms","WS")]:
         ys = [r[key] for r in rows]
+        if any(y == "" for y in ys): continue
         plt.figure()
         plt.plot(xs, ys, marker="o")
         plt.xlabel("Hilos (T)")
@@ -176,5 +435,70 @@ def main():
     except Exception as e:
         print("[WARN] No se pudo graficar P5:", e)
 
+def main_sweep(argv):
+    ap = argparse.ArgumentParser(description="Sweep de escalabilidad p1/p3 con ajuste USL, gate de regresión "
+                                             "y grilla de staleness del contador aproximado")
+    ap.add_argument("--sweep", action="store_true", help="correr el sweep T=1..max-threads")
+    ap.add_argument("--max-threads", type=int, default=os.cpu_count() or 1)
+    ap.add_argument("--reps", type=int, default=5)
+    ap.add_argument("--iters", type=int, default=1_000_000)
+    ap.add_argument("--current", type=Path, default=OUT/"scaling_sweep.csv",
+                    help="CSV del sweep (se escribe con --sweep, se lee si no)")
+    ap.add_argument("--baseline", type=Path, help="CSV de un sweep anterior para comparar")
+    ap.add_argument("--min-drop-pct", type=float, default=5.0)
+    ap.add_argument("--noise-k", type=float, default=3.0)
+    ap.add_argument("--staleness", action="store_true",
+                    help="solo la grilla K x D del contador aproximado de p1")
+    ap.add_argument("--p3-keys", action="store_true",
+                    help="solo la grilla K x S (uniform y zipf) de p3 -> data/p3_keys.csv")
+    a = ap.parse_args(argv)
+
+    if a.p3_keys:
+        print(f"=== P3 almacén con claves: ops/s vs K y S (T={a.max_threads}) ===")
+        rows = bench_p3_keys(a.max_threads, reps=3)
+        try:
+            plot_p3_keys(rows)
+        except Exception as e:
+            print("[WARN] No se pudo graficar P3 claves:", e)
+        return 0
+
+    if a.staleness:
+        print(f"=== P1 aproximado: throughput vs staleness (T={a.max_threads}) ===")
+        rows = bench_staleness(a.max_threads, reps=3)
+        try:
+            plot_staleness(rows)
+        except Exception as e:
+            print("[WARN] No se pudo graficar staleness:", e)
+        return 0
+
+    fields = ["bench", "strategy", "threads", "ops_s", "mad", "reps"]
+    if a.sweep:
+        print(f"=== Sweep T=1..{a.max_threads} ({a.reps} reps) ===")
+        rows = sweep(a.max_threads, reps=a.reps, iters=a.iters)
+        write_csv(a.current, rows, fields)
+    else:
+        with open(a.current, newline="") as f:
+            rows = [{**r, "threads": int(r["threads"]), "ops_s": float(r["ops_s"])} for r in csv.DictReader(f)]
+
+    fits = usl_rows(rows)
+    if fits:
+        write_csv(OUT/"usl_fit.csv", fits, ["bench", "strategy", "lambda", "sigma", "kappa", "n_peak", "r2"])
+        for r in fits:
+            print(f"  {r['bench']}/{r['strategy']:<10} sigma={r['sigma']:.4f}  kappa={r['kappa']:.6f}"
+                  f"  N*={r['n_peak']}  R2={r['r2']}")
+
+    if a.baseline:
+        print(f"=== Comparación contra {a.baseline} ===")
+        failures = compare_baseline(read_sweep_csv(a.current), read_sweep_csv(a.baseline),
+                                    a.min_drop_pct, a.noise_k)
+        if failures:
+            print(f"[FAIL] {len(failures)} punto(s) con regresión de throughput o ausentes")
+            return 1
+        print("[OK] Sin regresiones")
+    return 0
+
 if __name__ == "__main__":
+    # Sin argumentos: benchmark clásico P1/P5. Con opciones: sweep/USL/gate.
+    if len(sys.argv) > 1:
+        sys.exit(main_sweep(sys.argv[1:]))
     main()
@@ -1,6 +1,7 @@
 #include "utils.h"
 
 #include <pthread.h>
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cstdlib>
@@ -8,6 +9,7 @@
 #include <iomanip>
 #include <iostream>
 #include <numeric>
+#include <unistd.h>
 #include <vector>
 
 using Clock = std::chrono::steady_clock;
@@ -41,15 +43,29 @@ void* worker_mutex(void* p) {
     return nullptr;
 }
 
-// 3) Sharded: cada hilo acumula local y luego reducimos
+// Desbalance inyectado: las unidades del primer bloque (1/T del rango total)
+// cuestan `skew` vueltas extra de un mezclador barato. Con skew=0 es local++.
+static inline long unit(long i, long heavy_end, int skew) {
+    if (i < heavy_end) {
+        unsigned long x = (unsigned long)i;
+        for (int k = 0; k < skew; ++k) x = x * 6364136223846793005UL + 1442695040888963407UL;
+        asm volatile("" : : "r"(x));
+    }
+    return 1;
+}
+
+// 3) Sharded: cada hilo acumula local y luego reducimos (partición estática)
 struct ShardArgs {
     long iters;
     long* out_local; // apunta al slot de este hilo
+    long begin;      // primer índice global de este hilo
+    long heavy_end;
+    int skew;
 };
 void* worker_sharded(void* p) {
     auto* a = static_cast<ShardArgs*>(p);
     long local = 0;
-    for (long i = 0; i < a->iters; ++i) local++;
+    for (long i = a->begin; i < a->begin + a->iters; ++i) local += unit(i, a->heavy_end, a->skew);
     *a->out_local = local;
     return nullptr;
 }
@@ -67,6 +83,67 @@ void* worker_atomic(void* p) {
     return nullptr;
 }
 
+// 6) Aproximado: cada hilo acumula local y publica al global cada K
+//    incrementos o cada D us, lo que llegue primero. El reloj se consulta cada
+//    64 incrementos para no pagar un now() por unidad.
+//    `mine` es la cuenta exacta del hilo; solo existe para medir staleness.
+struct alignas(64) Progress {
+    std::atomic<long> n{0};
+};
+struct ApproxArgs {
+    long iters;
+    long K;
+    long D_ns;                 // 0 = sin límite de tiempo
+    std::atomic<long>* global;
+    Progress* mine;
+};
+void* worker_approx(void* p) {
+    auto* a = static_cast<ApproxArgs*>(p);
+    long pending = 0;
+    auto last = Clock::now();
+    for (long i = 0; i < a->iters; ++i) {
+        pending++;
+        a->mine->n.store(i + 1, std::memory_order_relaxed);
+        bool flush = pending >= a->K;
+        // El reloj solo se lee cada 64 incrementos y `last` solo se reinicia en
+        // los flush por tiempo: un flush por K no lo toca, lo que a lo sumo
+        // adelanta el siguiente flush por tiempo y mantiene la cota D.
+        if (!flush && a->D_ns > 0 && (i & 63) == 0) {
+            auto now = Clock::now();
+            if (std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count() >= a->D_ns) {
+                flush = true;
+                last = now;
+            }
+        }
+        if (flush) {
+            a->global->fetch_add(pending, std::memory_order_relaxed);
+            pending = 0;
+        }
+    }
+    if (pending) a->global->fetch_add(pending, std::memory_order_relaxed);
+    return nullptr;
+}
+
+// Lector: mientras corren los workers compara el global con la suma exacta
+struct ReaderArgs {
+    std::atomic<long>* global;
+    Progress* progress;
+    int T;
+    std::atomic<bool>* stop;
+    std::vector<long> staleness; // cuenta real - cuenta publicada, por muestra
+};
+void* reader_approx(void* p) {
+    auto* r = static_cast<ReaderArgs*>(p);
+    while (!r->stop->load(std::memory_order_acquire)) {
+        long seen = r->global->load(std::memory_order_relaxed); // primero el global: nunca negativo
+        long real = 0;
+        for (int i = 0; i < r->T; ++i) real += r->progress[i].n.load(std::memory_order_relaxed);
+        r->staleness.push_back(std::max(0L, real - seen));
+        usleep(100);
+    }
+    return nullptr;
+}
+
 // -------------------- Helpers --------------------
 
 template <class F, class A>
@@ -88,14 +165,22 @@ double run_threads(int T, F fn, A mkArgs, long& /*out_value*/) {
 int main(int argc, char** argv) {
     print_banner("Practica 1 - Contador con hilos");
 
-    // Argumentos: T (hilos) e iters (unidades de trabajo por hilo)
+    // Argumentos: T (hilos), iters (unidades de trabajo por hilo), skew
+    // (costo extra por unidad en el primer bloque, solo sharded/ws) y K/D
+    // del contador aproximado (publicar cada K incrementos o D us)
     int  T     = (argc > 1) ? arg_to_int_or(argv[1], 4) : 4;
     long iters = (argc > 2) ? arg_to_int_or(argv[2], 1000000) : 1000000;
+    int  skew  = (argc > 3) ? arg_to_int_or(argv[3], 0) : 0;
+    long K     = (argc > 4) ? arg_to_int_or(argv[4], 1024) : 1024;
+    long D_us  = (argc > 5) ? arg_to_int_or(argv[5], 100) : 100;
 
     if (T <= 0) { std::cerr << "T debe ser > 0\n"; return 1; }
     if (iters <= 0) { std::cerr << "iters debe ser > 0\n"; return 1; }
+    if (skew < 0) { std::cerr << "skew debe ser >= 0\n"; return 1; }
+    if (K <= 0 || D_us < 0) { std::cerr << "K debe ser > 0 y D >= 0\n"; return 1; }
 
-    std::cout << "T=" << T << "  iters=" << iters << "\n\n";
+    std::cout << "T=" << T << "  iters=" << iters << "  skew=" << skew
+              << "  K=" << K << "  D_us=" << D_us << "\n\n";
 
     // --------------------------------------------------
     // 1) NAIVE (con race)
@@ -138,6 +223,9 @@ int main(int argc, char** argv) {
     for (int i = 0; i < T; ++i) {
         args_sharded[i].iters     = iters;
         args_sharded[i].out_local = &partials[i];
+        args_sharded[i].begin     = i * iters;
+        args_sharded[i].heavy_end = iters;
+        args_sharded[i].skew      = skew;
     }
 
     double t_sharded = run_threads(
@@ -170,11 +258,76 @@ int main(int argc, char** argv) {
               << "  esperado=" << (long)T * iters
               << "  tiempo=" << std::fixed << std::setprecision(2) << t_atomic << " ms\n";
 
+    // --------------------------------------------------
+    // 5) WORK-STEALING: misma reducción que SHARDED, pero el rango se reparte
+    //    dinámicamente y los hilos ociosos roban trozos del bloque pesado
+    long global_ws = 0;
+    double t_ws = 0.0;
+    {
+        WsPool pool(T);
+        const long total = (long)T * iters;
+        const long grain = std::max(1L, std::min(iters, 4096L));
+
+        auto t0 = Clock::now();
+        global_ws = pool.parallel_reduce(
+            0L, total, grain, 0L,
+            [&](long lo, long hi) {
+                long local = 0;
+                for (long i = lo; i < hi; ++i) local += unit(i, iters, skew);
+                return local;
+            },
+            [](long x, long y) { return x + y; });
+        auto t1 = Clock::now();
+        t_ws = std::chrono::duration_cast<ms>(t1 - t0).count();
+    }
+
+    std::cout << "[WS]      valor=" << global_ws
+              << "  esperado=" << (long)T * iters
+              << "  tiempo=" << std::fixed << std::setprecision(2) << t_ws << " ms\n";
+
+    // --------------------------------------------------
+    // 6) APPROX: staleness acotada (por cuenta: T*K; por tiempo: ~D us)
+    std::atomic<long> global_approx{0};
+    std::vector<Progress> progress(T);
+    std::vector<ApproxArgs> args_approx(T);
+    for (int i = 0; i < T; ++i)
+        args_approx[i] = ApproxArgs{iters, K, D_us * 1000, &global_approx, &progress[i]};
+
+    std::atomic<bool> stop_reader{false};
+    ReaderArgs rargs{&global_approx, progress.data(), T, &stop_reader, {}};
+    rargs.staleness.reserve(1 << 16);
+    pthread_t reader;
+    pthread_create(&reader, nullptr, reader_approx, &rargs);
+
+    double t_approx = run_threads(
+        T,
+        worker_approx,
+        [&](int i) -> void* { return &args_approx[i]; },
+        *reinterpret_cast<long*>(&global_approx) // no se usa
+    );
+    stop_reader.store(true, std::memory_order_release);
+    pthread_join(reader, nullptr);
+
+    std::vector<long>& st = rargs.staleness;
+    std::sort(st.begin(), st.end());
+    double st_avg = st.empty() ? 0.0 : std::accumulate(st.begin(), st.end(), 0.0) / st.size();
+    long st_p99 = st.empty() ? 0 : st[(st.size() * 99) / 100];
+    long st_max = st.empty() ? 0 : st.back();
+
+    std::cout << "[APPROX]  valor=" << global_approx.load()
+              << "  esperado=" << (long)T * iters
+              << "  tiempo=" << std::fixed << std::setprecision(2) << t_approx << " ms\n"
+              << "          staleness (cuentas): muestras=" << st.size()
+              << "  prom=" << st_avg << "  p99=" << st_p99 << "  max=" << st_max
+              << "  cota T*K=" << (long)T * K << "\n";
+
     // --------------------------------------------------
     std::cout << "\nResumen (ms): naive=" << t_naive
               << "  mutex=" << t_mutex
               << "  sharded=" << t_sharded
-              << "  atomic=" << t_atomic << "\n";
+              << "  atomic=" << t_atomic
+              << "  ws=" << t_ws
+              << "  approx=" << t_approx << "\n";
 
     return 0;
 }
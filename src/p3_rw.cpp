@@ -2,45 +2,97 @@
 #include <pthread.h>
 #include <vector>
 #include <iostream>
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cmath>
 #include <cassert>
+#include <string>
 
 using clk = std::chrono::steady_clock;
 
-struct Shared {
+// Una entrada por línea de caché para que claves distintas no compartan línea.
+// `ver` solo lo usa el modo optimista: par = estable, impar = escritura en curso.
+// value es atómico (relaxed) para que la lectura optimista no sea una carrera.
+struct alignas(64) Entry {
+    std::atomic<long> value{0};
+    std::atomic<unsigned long> ver{0};
+};
 
-    long value = 0;
+struct alignas(64) Stripe {
+    pthread_rwlock_t rw = PTHREAD_RWLOCK_INITIALIZER;
+};
+
+struct Shared {
+    // K entradas (K=1 es el long único de siempre)
+    std::vector<Entry> entries;
 
     // Locks
     pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
     pthread_rwlock_t rw = PTHREAD_RWLOCK_INITIALIZER;
+    std::vector<Stripe> stripes; // clave k -> stripes[k % S]
+
+    Shared(int K, int S) : entries(K), stripes(S) {}
+
+    long total() const {
+        long sum = 0;
+        for (auto& e : entries) sum += e.value.load(std::memory_order_relaxed);
+        return sum;
+    }
 };
 
-// -------------------------------
-// Hilo para la corrida con MUTEX
-// -------------------------------
-struct ArgsMutex {
+// Selector de clave por hilo: uniforme, o Zipf si hay tabla cdf
+struct KeyPicker {
+    const std::vector<double>* cdf = nullptr;
+    int K = 1;
+    unsigned long state = 1;
+
+    int next() {
+        // xorshift64
+        state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+        if (K == 1) return 0;
+        if (!cdf) return (int)(state % (unsigned long)K);
+        double u = (state >> 11) * (1.0 / 9007199254740992.0); // [0,1)
+        int k = (int)(std::upper_bound(cdf->begin(), cdf->end(), u) - cdf->begin());
+        return std::min(k, K - 1);
+    }
+};
+
+// CDF de Zipf con exponente s sobre K claves (la clave 0 es la más caliente)
+static std::vector<double> zipf_cdf(int K, double s) {
+    std::vector<double> cdf(K);
+    double acc = 0.0;
+    for (int k = 0; k < K; ++k) { acc += 1.0 / std::pow(k + 1, s); cdf[k] = acc; }
+    for (auto& c : cdf) c /= acc;
+    return cdf;
+}
+
+struct Args {
     Shared* s;
     bool is_writer;
     long ops;
+    KeyPicker kp;
     // métricas
     long reads_done = 0;
     long writes_done = 0;
 };
 
+// -------------------------------
+// Hilo para la corrida con MUTEX
+// -------------------------------
 void* worker_mutex(void* p) {
-    auto* a = static_cast<ArgsMutex*>(p);
+    auto* a = static_cast<Args*>(p);
     for (long i = 0; i < a->ops; ++i) {
+        Entry& e = a->s->entries[a->kp.next()];
         if (a->is_writer) {
             pthread_mutex_lock(&a->s->mtx);
-            a->s->value += 1;        // escritura simple
+            e.value.store(e.value.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed); // escritura simple
             pthread_mutex_unlock(&a->s->mtx);
             a->writes_done++;
         } else {
             pthread_mutex_lock(&a->s->mtx);
-            volatile long x = a->s->value; // simulamos lectura
+            volatile long x = e.value.load(std::memory_order_relaxed); // simulamos lectura
             (void)x;
             pthread_mutex_unlock(&a->s->mtx);
             a->reads_done++;
@@ -52,25 +104,19 @@ void* worker_mutex(void* p) {
 // ---------------------------------
 // Hilo para la corrida con RWLOCK
 // ---------------------------------
-struct ArgsRW {
-    Shared* s;
-    bool is_writer;
-    long ops;
-    long reads_done = 0;
-    long writes_done = 0;
-};
-
 void* worker_rw(void* p) {
-    auto* a = static_cast<ArgsRW*>(p);
+    auto* a = static_cast<Args*>(p);
     for (long i = 0; i < a->ops; ++i) {
+        Entry& e = a->s->entries[a->kp.next()];
         if (a->is_writer) {
             pthread_rwlock_wrlock(&a->s->rw);
-            a->s->value += 1;
+            e.value.store(e.value.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
             pthread_rwlock_unlock(&a->s->rw);
             a->writes_done++;
         } else {
             pthread_rwlock_rdlock(&a->s->rw);
-            volatile long x = a->s->value;
+            volatile long x = e.value.load(std::memory_order_relaxed);
             (void)x;
             pthread_rwlock_unlock(&a->s->rw);
             a->reads_done++;
@@ -79,22 +125,123 @@ void* worker_rw(void* p) {
     return nullptr;
 }
 
+// ----------------------------------------------
+// Hilo para la corrida con STRIPING (S rwlocks)
+// ----------------------------------------------
+void* worker_striped(void* p) {
+    auto* a = static_cast<Args*>(p);
+    const int S = (int)a->s->stripes.size();
+    for (long i = 0; i < a->ops; ++i) {
+        int k = a->kp.next();
+        Entry& e = a->s->entries[k];
+        pthread_rwlock_t* rw = &a->s->stripes[k % S].rw;
+        if (a->is_writer) {
+            pthread_rwlock_wrlock(rw);
+            e.value.store(e.value.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+            pthread_rwlock_unlock(rw);
+            a->writes_done++;
+        } else {
+            pthread_rwlock_rdlock(rw);
+            volatile long x = e.value.load(std::memory_order_relaxed);
+            (void)x;
+            pthread_rwlock_unlock(rw);
+            a->reads_done++;
+        }
+    }
+    return nullptr;
+}
+
+// ---------------------------------------------------------------
+// Hilo para la corrida OPTIMISTA (versión por entrada, tipo seqlock)
+// Lectores no escriben memoria compartida: leen ver, valor y ver otra
+// vez, y reintentan si cambió. Escritores toman la entrada con un CAS
+// de ver par -> impar.
+// ---------------------------------------------------------------
+void* worker_optimistic(void* p) {
+    auto* a = static_cast<Args*>(p);
+    for (long i = 0; i < a->ops; ++i) {
+        Entry& e = a->s->entries[a->kp.next()];
+        if (a->is_writer) {
+            unsigned long v = e.ver.load(std::memory_order_relaxed);
+            while ((v & 1) || !e.ver.compare_exchange_weak(v, v + 1, std::memory_order_acquire,
+                                                           std::memory_order_relaxed))
+                v = e.ver.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release); // ver impar antes que el dato
+            e.value.store(e.value.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+            e.ver.store(v + 2, std::memory_order_release);
+            a->writes_done++;
+        } else {
+            unsigned long v0, v1;
+            long x;
+            do {
+                v0 = e.ver.load(std::memory_order_acquire);
+                x = e.value.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                v1 = e.ver.load(std::memory_order_relaxed);
+            } while ((v0 & 1) || v0 != v1);
+            volatile long sink = x;
+            (void)sink;
+            a->reads_done++;
+        }
+    }
+    return nullptr;
+}
+
 static inline double ms_since(clk::time_point t0, clk::time_point t1) {
     return std::chrono::duration<double, std::milli>(t1 - t0).count();
 }
 
+// Lanza T hilos con `fn` sobre un Shared nuevo e imprime el resultado
+static void run_case(const char* tag, void* (*fn)(void*), int T, int W, long OPS,
+                     int K, int S, const std::vector<double>* cdf, bool last) {
+    Shared sh(K, S);
+    std::vector<pthread_t> th(T);
+    std::vector<Args> args(T);
+
+    // Asignar roles: primeros W = escritores, resto lectores
+    for (int i = 0; i < T; ++i) {
+        args[i] = { &sh, i < W, OPS, KeyPicker{cdf, K, 0x9E3779B97F4A7C15UL * (i + 1)}, 0, 0 };
+    }
+
+    auto t0 = clk::now();
+    for (int i = 0; i < T; ++i) {
+        pthread_create(&th[i], nullptr, fn, &args[i]);
+    }
+    for (int i = 0; i < T; ++i) pthread_join(th[i], nullptr);
+    auto t1 = clk::now();
+
+    long total_reads = 0, total_writes = 0;
+    for (auto& a : args) { total_reads += a.reads_done; total_writes += a.writes_done; }
+    const double ms = ms_since(t0, t1);
+
+    std::cout << tag << "\n";
+    std::cout << "  valor final=" << sh.total()
+              << "  writes=" << total_writes
+              << "  reads="  << total_reads
+              << "  tiempo=" << ms << " ms"
+              << "  ops/s=" << (long)((total_reads + total_writes) / (ms / 1000.0))
+              << (last ? "\n" : "\n\n");
+}
+
 int main(int argc, char** argv) {
     print_banner("Practica 3 - Lectores/Escritores (mutex vs rwlock)");
 
     if (argc < 4) {
-        std::cerr << "Uso: " << argv[0] << " <hilos_totales> <porc_escritores 0..100> <ops_por_hilo>\n";
+        std::cerr << "Uso: " << argv[0] << " <hilos_totales> <porc_escritores 0..100> <ops_por_hilo>"
+                     " [claves K=1] [stripes S=1] [uniform|zipf]\n";
         return 1;
     }
     const int  T   = arg_to_int_or(argv[1], 8);
     const int  WP  = arg_to_int_or(argv[2], 25); // porcentaje de escritores
     const long OPS = arg_to_int_or(argv[3], 200000);
+    const int  K   = (argc > 4) ? arg_to_int_or(argv[4], 1) : 1;
+    const int  S   = (argc > 5) ? arg_to_int_or(argv[5], 1) : 1;
+    const std::string dist = (argc > 6) ? argv[6] : "uniform";
 
-    if (T <= 0 || WP < 0 || WP > 100 || OPS <= 0) {
+    if (T <= 0 || WP < 0 || WP > 100 || OPS <= 0 || K <= 0 || S <= 0 ||
+        (dist != "uniform" && dist != "zipf")) {
         std::cerr << "Parámetros inválidos.\n";
         return 1;
     }
@@ -103,66 +250,21 @@ int main(int argc, char** argv) {
     const int R = T - W;
 
     std::cout << "T=" << T << "  writers=" << W << "  readers=" << R
-              << "  ops/hilo=" << OPS << "\n\n";
-
-    // -------------------------
-    // 1) Corrida con MUTEX
-    // -------------------------
-    {
-        Shared S;
-        std::vector<pthread_t> th(T);
-        std::vector<ArgsMutex> args(T);
-
-        // Asignar roles: primeros W = escritores, resto lectores
-        for (int i = 0; i < T; ++i) {
-            args[i] = { &S, i < W, OPS, 0, 0 };
-        }
-
-        auto t0 = clk::now();
-        for (int i = 0; i < T; ++i) {
-            pthread_create(&th[i], nullptr, worker_mutex, &args[i]);
-        }
-        for (int i = 0; i < T; ++i) pthread_join(th[i], nullptr);
-        auto t1 = clk::now();
+              << "  ops/hilo=" << OPS
+              << "  K=" << K << "  S=" << S << "  dist=" << dist << "\n\n";
 
-        long total_reads = 0, total_writes = 0;
-        for (auto& a : args) { total_reads += a.reads_done; total_writes += a.writes_done; }
+    std::vector<double> cdf;
+    if (dist == "zipf") cdf = zipf_cdf(K, 0.99);
+    const std::vector<double>* pcdf = cdf.empty() ? nullptr : &cdf;
 
-        std::cout << "[MUTEX]\n";
-        std::cout << "  valor final=" << S.value
-                  << "  writes=" << total_writes
-                  << "  reads="  << total_reads
-                  << "  tiempo=" << ms_since(t0, t1) << " ms\n\n";
-    }
-
-    // -------------------------
-    // 2) Corrida con RWLOCK
-    // -------------------------
-    {
-        Shared S;
-        std::vector<pthread_t> th(T);
-        std::vector<ArgsRW> args(T);
-
-        for (int i = 0; i < T; ++i) {
-            args[i] = { &S, i < W, OPS, 0, 0 };
-        }
-
-        auto t0 = clk::now();
-        for (int i = 0; i < T; ++i) {
-            pthread_create(&th[i], nullptr, worker_rw, &args[i]);
-        }
-        for (int i = 0; i < T; ++i) pthread_join(th[i], nullptr);
-        auto t1 = clk::now();
-
-        long total_reads = 0, total_writes = 0;
-        for (auto& a : args) { total_reads += a.reads_done; total_writes += a.writes_done; }
-
-        std::cout << "[RWLOCK]\n";
-        std::cout << "  valor final=" << S.value
-                  << "  writes=" << total_writes
-                  << "  reads="  << total_reads
-                  << "  tiempo=" << ms_since(t0, t1) << " ms\n";
-    }
+    // 1) Un mutex global
+    run_case("[MUTEX]",      worker_mutex,      T, W, OPS, K, S, pcdf, false);
+    // 2) Un rwlock global
+    run_case("[RWLOCK]",     worker_rw,         T, W, OPS, K, S, pcdf, false);
+    // 3) S rwlocks, clave k protegida por k % S
+    run_case("[STRIPED]",    worker_striped,    T, W, OPS, K, S, pcdf, false);
+    // 4) Lecturas optimistas con versión por entrada
+    run_case("[OPTIMISTIC]", worker_optimistic, T, W, OPS, K, S, pcdf, true);
 
     return 0;
 }
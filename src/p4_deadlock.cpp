@@ -2,6 +2,7 @@
 #include "utils.h"            // No lo usamos directamente, pero sirve para la regla del Makefile
 #include <pthread.h>
 #include <unistd.h>           // usleep
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cstdio>
@@ -13,18 +14,52 @@
 struct Locks {
     pthread_mutex_t A = PTHREAD_MUTEX_INITIALIZER;
     pthread_mutex_t B = PTHREAD_MUTEX_INITIALIZER;
+    // Solo modo adaptive: cada unlock incrementa el contador de su lock para
+    // despertar a quien esté estacionado (futex) esperando ese lock
+    std::atomic<int> relA{0};
+    std::atomic<int> relB{0};
+    std::atomic<int> parked{0};
+};
+
+// Ventana de equidad: cuando termina el primer hilo se congelan los hits de
+// ambos. Después de ese punto el otro corre solo y sin competencia, así que
+// solo lo anterior sirve para comparar cuánto consiguió cada uno.
+struct Fair {
+    std::atomic<int> done{0};
+    long hits[2] = {0, 0};
+    long end_ns = 0;
 };
 
 struct Args {
     int id;                   // 0 o 1
     long iters;
     int pause_us;             // pausa entre el 1er y 2do lock (microseg)
-    const char* mode;         // "deadlock" | "trylock" | "ordered"
+    const char* mode;         // "deadlock" | "trylock" | "ordered" | "adaptive"
     Locks* lks;
     std::atomic<long>* hits;  // contador por hilo
     std::atomic<long>* global_hits;
+    std::vector<long>* lat;   // ns desde que pide el 1er lock hasta tener ambos
+    Fair* fair;
 };
 
+static inline long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void mark_finished(Args* a) {
+    if (a->fair->done.fetch_add(1, std::memory_order_acq_rel) != 0) return;
+    a->fair->end_ns = now_ns();
+    a->fair->hits[0] = a->hits[0].load(std::memory_order_relaxed);
+    a->fair->hits[1] = a->hits[1].load(std::memory_order_relaxed);
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
 static void* worker_deadlock(void* p) {
     auto* a = static_cast<Args*>(p);
     Locks* L = a->lks;
@@ -68,6 +103,7 @@ static void* worker_trylock(void* p) {
     int backoff = base_backoff;
 
     for (long i = 0; i < a->iters; ++i) {
+        long t0 = now_ns();
         // Tomar el primero (bloqueante)
         pthread_mutex_lock(first);
         if (a->pause_us > 0) usleep(a->pause_us);
@@ -85,6 +121,7 @@ static void* worker_trylock(void* p) {
             if (a->pause_us > 0) usleep(a->pause_us);
         }
         // Ya tenemos ambos
+        a->lat->push_back(now_ns() - t0);
 
         a->hits[a->id].fetch_add(1, std::memory_order_relaxed);
         a->global_hits->fetch_add(1, std::memory_order_relaxed);
@@ -95,6 +132,80 @@ static void* worker_trylock(void* p) {
         // Relajar el backoff tras una pasada exitosa
         backoff = base_backoff;
     }
+    mark_finished(a);
+    return nullptr;
+}
+
+// Estrategia "adaptive": acotar la latencia de cola del trylock.
+//  1) Girar unos ciclos con pause reintentando el 2do lock (colisión corta).
+//  2) Soltar el 1ro y dormir un tiempo aleatorio creciente pero pequeño, para
+//     romper la simetría entre los dos hilos sin esperar decenas de ms.
+//  3) Si sigue ocupado, estacionarse en un futex hasta que el dueño del 2do
+//     lock lo libere (nada de dormir "a ciegas").
+static const int ADAPT_SPINS = 64;
+static const int ADAPT_JITTER_ROUNDS = 4;
+static const int ADAPT_JITTER_MAX_US = 200;
+
+static void unlock_notify(Locks* L, pthread_mutex_t* m, std::atomic<int>* rel) {
+    pthread_mutex_unlock(m);
+    rel->fetch_add(1, std::memory_order_seq_cst);
+    if (L->parked.load(std::memory_order_seq_cst) > 0) futex_wake(rel, 2);
+}
+
+static void* worker_adaptive(void* p) {
+    auto* a = static_cast<Args*>(p);
+    Locks* L = a->lks;
+
+    pthread_mutex_t* first  = (a->id == 0) ? &L->A : &L->B;
+    pthread_mutex_t* second = (a->id == 0) ? &L->B : &L->A;
+    std::atomic<int>* rel_first  = (a->id == 0) ? &L->relA : &L->relB;
+    std::atomic<int>* rel_second = (a->id == 0) ? &L->relB : &L->relA;
+
+    unsigned rng = 0x9E3779B9u * (unsigned)(a->id + 1);
+
+    for (long i = 0; i < a->iters; ++i) {
+        long t0 = now_ns();
+        pthread_mutex_lock(first);
+        if (a->pause_us > 0) usleep(a->pause_us);
+
+        int round = 0;
+        int spins = 0;
+        while (pthread_mutex_trylock(second) != 0) {
+            if (spins < ADAPT_SPINS) {               // 1) spin
+                ++spins;
+                cpu_relax();
+                continue;
+            }
+            unlock_notify(L, first, rel_first);
+            if (round < ADAPT_JITTER_ROUNDS) {        // 2) backoff con jitter
+                rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+                int cap = std::min(ADAPT_JITTER_MAX_US, 10 << round);
+                usleep(1 + rng % (unsigned)cap);
+                ++round;
+            } else {                                  // 3) estacionar
+                L->parked.fetch_add(1, std::memory_order_seq_cst);
+                int key = rel_second->load(std::memory_order_seq_cst);
+                if (pthread_mutex_trylock(second) == 0) {
+                    // se liberó entre medio: no dormir
+                    pthread_mutex_unlock(second);
+                } else {
+                    futex_wait(rel_second, key);
+                }
+                L->parked.fetch_sub(1, std::memory_order_relaxed);
+            }
+            spins = 0;
+            pthread_mutex_lock(first);
+            if (a->pause_us > 0) usleep(a->pause_us);
+        }
+        a->lat->push_back(now_ns() - t0);
+
+        a->hits[a->id].fetch_add(1, std::memory_order_relaxed);
+        a->global_hits->fetch_add(1, std::memory_order_relaxed);
+
+        unlock_notify(L, second, rel_second);
+        unlock_notify(L, first, rel_first);
+    }
+    mark_finished(a);
     return nullptr;
 }
 
@@ -109,9 +220,11 @@ static void* worker_ordered(void* p) {
     if (m2 < m1) std::swap(m1, m2);
 
     for (long i = 0; i < a->iters; ++i) {
+        long t0 = now_ns();
         pthread_mutex_lock(m1);
         if (a->pause_us > 0) usleep(a->pause_us);
         pthread_mutex_lock(m2);
+        a->lat->push_back(now_ns() - t0);
 
         a->hits[a->id].fetch_add(1, std::memory_order_relaxed);
         a->global_hits->fetch_add(1, std::memory_order_relaxed);
@@ -119,21 +232,46 @@ static void* worker_ordered(void* p) {
         pthread_mutex_unlock(m2);
         pthread_mutex_unlock(m1);
     }
+    mark_finished(a);
     return nullptr;
 }
 
+// Percentiles e histograma log2 (us) de las latencias de adquisición
+static void print_latency(const char* tag, std::vector<long> v) {
+    if (v.empty()) return;
+    std::sort(v.begin(), v.end());
+    auto pct = [&](double q) { return v[std::min(v.size() - 1, (size_t)(q * v.size()))] / 1000.0; };
+    std::printf("  %s  n=%zu  p50=%.1f us  p99=%.1f us  p99.9=%.1f us  max=%.1f us\n",
+                tag, v.size(), pct(0.50), pct(0.99), pct(0.999), v.back() / 1000.0);
+
+    long bucket[24] = {0}; // [0,1us) [1,2) [2,4) ... 
+    for (long ns : v) {
+        long us = ns / 1000;
+        int b = 0;
+        while (us > 0 && b < 23) { us >>= 1; ++b; }
+        bucket[b]++;
+    }
+    std::printf("    hist(us):");
+    for (int b = 0; b < 24; ++b) {
+        if (!bucket[b]) continue;
+        std::printf(" <%ld:%ld", 1L << b, bucket[b]);
+    }
+    std::printf("\n");
+}
+
 static void usage(const char* prog) {
     std::fprintf(stderr,
         "Uso: %s <mode> [iters] [pause_us]\n"
-        "  <mode>      : deadlock | trylock | ordered\n"
+        "  <mode>      : deadlock | trylock | ordered | adaptive\n"
         "  [iters]     : iteraciones por hilo (def=100000)\n"
         "  [pause_us]  : microsegundos entre el 1er y 2do lock (def=1000)\n"
         "\n"
         "Ejemplos:\n"
         "  %s deadlock 100000 5000\n"
         "  %s trylock  200000 10000\n"
-        "  %s ordered  200000 0\n",
-        prog, prog, prog, prog);
+        "  %s ordered  200000 0\n"
+        "  %s adaptive 200000 10000\n",
+        prog, prog, prog, prog, prog);
 }
 
 int main(int argc, char** argv) {
@@ -145,7 +283,8 @@ int main(int argc, char** argv) {
     long iters = (argc >= 3) ? std::strtol(argv[2], nullptr, 10) : 100000;
     int pause_us = (argc >= 4) ? std::atoi(argv[3]) : 1000;
 
-    if (mode != "deadlock" && mode != "trylock" && mode != "ordered") {
+    if ((mode != "deadlock" && mode != "trylock" && mode != "ordered" && mode != "adaptive") ||
+        iters < 0) {
         usage(argv[0]);
         return 1;
     }
@@ -161,8 +300,15 @@ int main(int argc, char** argv) {
     hits_per_thread[1] = 0;
     std::atomic<long> global_hits{0};
 
-    Args a0{0, iters, pause_us, mode.c_str(), &L, hits_per_thread, &global_hits};
-    Args a1{1, iters, pause_us, mode.c_str(), &L, hits_per_thread, &global_hits};
+    std::vector<long> lat[2];
+    if (mode != "deadlock") {
+        lat[0].reserve(iters);
+        lat[1].reserve(iters);
+    }
+
+    Fair fair;
+    Args a0{0, iters, pause_us, mode.c_str(), &L, hits_per_thread, &global_hits, &lat[0], &fair};
+    Args a1{1, iters, pause_us, mode.c_str(), &L, hits_per_thread, &global_hits, &lat[1], &fair};
 
     pthread_t t0, t1;
 
@@ -171,6 +317,7 @@ int main(int argc, char** argv) {
     void* (*fn)(void*) = nullptr;
     if (mode == "deadlock") fn = &worker_deadlock;
     else if (mode == "trylock") fn = &worker_trylock;
+    else if (mode == "adaptive") fn = &worker_adaptive;
     else fn = &worker_ordered;
 
     pthread_create(&t0, nullptr, fn, &a0);
@@ -228,9 +375,30 @@ int main(int argc, char** argv) {
         }
     } else if (mode == "trylock") {
         std::printf("  Estrategia: trylock + backoff para esquivar interbloqueos.\n");
+    } else if (mode == "adaptive") {
+        std::printf("  Estrategia: trylock + spin, backoff con jitter y futex hasta la liberación.\n");
     } else {
         std::printf("  Estrategia: orden global de locks (jerarquía) para prevenir deadlock.\n");
     }
 
+    // Latencia de adquisición y equidad (no aplica a deadlock: los hilos siguen vivos)
+    if (mode != "deadlock") {
+        long start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            start.time_since_epoch()).count();
+        double secs = (fair.end_ns - start_ns) / 1e9;
+        long both = fair.hits[0] + fair.hits[1];
+        long best = std::max(fair.hits[0], fair.hits[1]);
+
+        std::printf("\nLatencia de adquisición (ambos locks):\n");
+        print_latency("hilo 0", lat[0]);
+        print_latency("hilo 1", lat[1]);
+        std::printf("Equidad (mientras compiten ambos, %.2f ms):\n", secs * 1000.0);
+        for (int i = 0; i < 2; ++i)
+            std::printf("  hilo %d: %ld acq  %.0f acq/s  share=%.1f%%  ratio=%.3f\n", i,
+                        fair.hits[i], secs > 0 ? fair.hits[i] / secs : 0.0,
+                        both > 0 ? 100.0 * fair.hits[i] / both : 0.0,
+                        best > 0 ? (double)fair.hits[i] / best : 0.0);
+    }
+
     return 0;
 }
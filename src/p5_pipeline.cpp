@@ -1,119 +1,1043 @@
 #include "utils.h"
 #include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
 #include <queue>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <vector>
 
 using namespace std;
 
+// Elemento que viaja por el pipeline. t_ns es el instante en que lo creó el
+// productor (CLOCK_MONOTONIC, válido entre procesos) para medir latencia.
+struct Item {
+    long val;
+    long t_ns;
+};
+
+static long now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
 struct Buffer {
-    queue<long> q;
+    queue<Item> q;
     pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
     pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER;
     pthread_cond_t not_full  = PTHREAD_COND_INITIALIZER;
     size_t max_size = 8;
 };
 
-// Inserta en el buffer
-void put(Buffer* b, long val) {
+// Inserta en el buffer. Si se bloquea por not_full, suma la espera a *waited_ns
+void put(Buffer* b, Item it, long* waited_ns = nullptr) {
     pthread_mutex_lock(&b->mtx);
-    while (b->q.size() >= b->max_size)
-        pthread_cond_wait(&b->not_full, &b->mtx);
+    if (b->q.size() >= b->max_size) {
+        long t0 = now_ns();
+        while (b->q.size() >= b->max_size)
+            pthread_cond_wait(&b->not_full, &b->mtx);
+        if (waited_ns) *waited_ns += now_ns() - t0;
+    }
 
-    b->q.push(val);
+    b->q.push(it);
 
     pthread_cond_signal(&b->not_empty);
     pthread_mutex_unlock(&b->mtx);
 }
 
-// Saca del buffer
-long get(Buffer* b) {
+// Saca del buffer. Si se bloquea por not_empty, suma la espera a *waited_ns
+Item get(Buffer* b, long* waited_ns = nullptr) {
     pthread_mutex_lock(&b->mtx);
-    while (b->q.empty())
-        pthread_cond_wait(&b->not_empty, &b->mtx);
+    if (b->q.empty()) {
+        long t0 = now_ns();
+        while (b->q.empty())
+            pthread_cond_wait(&b->not_empty, &b->mtx);
+        if (waited_ns) *waited_ns += now_ns() - t0;
+    }
 
-    long val = b->q.front();
+    Item it = b->q.front();
     b->q.pop();
 
     pthread_cond_signal(&b->not_full);
     pthread_mutex_unlock(&b->mtx);
-    return val;
+    return it;
+}
+
+// ===== Canal entre procesos (memoria compartida) =====
+
+// Anillo de capacidad fija que vive en un mapeo memfd. El mutex y las
+// condiciones son PTHREAD_PROCESS_SHARED para seguir funcionando tras fork().
+// Los slots van justo después de la cabecera.
+struct ShmRing {
+    pthread_mutex_t mtx;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    size_t head, tail, count, cap;
+
+    Item* slots() { return reinterpret_cast<Item*>(this + 1); }
+};
+
+static size_t shm_ring_bytes(size_t cap) {
+    return sizeof(ShmRing) + cap * sizeof(Item);
+}
+
+// Reserva memoria compartida anónima que heredan los hijos de fork()
+static void* shm_alloc(size_t bytes) {
+    int fd = memfd_create("p5_pipeline", MFD_CLOEXEC);
+    if (fd < 0) { perror("memfd_create"); return nullptr; }
+    if (ftruncate(fd, (off_t)bytes) != 0) { perror("ftruncate"); close(fd); return nullptr; }
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // el mapeo mantiene vivo el objeto
+    if (p == MAP_FAILED) { perror("mmap"); return nullptr; }
+    return p;
+}
+
+static void shm_ring_init(ShmRing* r, size_t cap) {
+    pthread_mutexattr_t ma;
+    pthread_mutexattr_init(&ma);
+    pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&r->mtx, &ma);
+    pthread_mutexattr_destroy(&ma);
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setpshared(&ca, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&r->not_empty, &ca);
+    pthread_cond_init(&r->not_full, &ca);
+    pthread_condattr_destroy(&ca);
+
+    r->head = r->tail = r->count = 0;
+    r->cap = cap;
+}
+
+static void shm_ring_destroy(ShmRing* r) {
+    pthread_cond_destroy(&r->not_full);
+    pthread_cond_destroy(&r->not_empty);
+    pthread_mutex_destroy(&r->mtx);
+}
+
+void put(ShmRing* r, Item it, long* waited_ns = nullptr) {
+    pthread_mutex_lock(&r->mtx);
+    if (r->count >= r->cap) {
+        long t0 = now_ns();
+        while (r->count >= r->cap)
+            pthread_cond_wait(&r->not_full, &r->mtx);
+        if (waited_ns) *waited_ns += now_ns() - t0;
+    }
+
+    r->slots()[r->tail] = it;
+    r->tail = (r->tail + 1) % r->cap;
+    r->count++;
+
+    pthread_cond_signal(&r->not_empty);
+    pthread_mutex_unlock(&r->mtx);
+}
+
+Item get(ShmRing* r, long* waited_ns = nullptr) {
+    pthread_mutex_lock(&r->mtx);
+    if (r->count == 0) {
+        long t0 = now_ns();
+        while (r->count == 0)
+            pthread_cond_wait(&r->not_empty, &r->mtx);
+        if (waited_ns) *waited_ns += now_ns() - t0;
+    }
+
+    Item it = r->slots()[r->head];
+    r->head = (r->head + 1) % r->cap;
+    r->count--;
+
+    pthread_cond_signal(&r->not_full);
+    pthread_mutex_unlock(&r->mtx);
+    return it;
+}
+
+// ===== Canal lock-free no acotado (MPMC) =====
+
+// Espera bloqueante para los consumidores del canal lock-free. En la ruta
+// rápida el productor solo lee `waiters`; el futex se toca si alguien duerme.
+struct EventCount {
+    atomic<int> seq{0};
+    atomic<int> waiters{0};
+
+    int prepare_wait() {
+        waiters.fetch_add(1, memory_order_seq_cst);
+        return seq.load(memory_order_seq_cst);
+    }
+    void cancel_wait() { waiters.fetch_sub(1, memory_order_relaxed); }
+    void commit_wait(int key) {
+        futex_wait(&seq, key);
+        waiters.fetch_sub(1, memory_order_relaxed);
+    }
+    void notify_one() {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (waiters.load(memory_order_relaxed) > 0) {
+            seq.fetch_add(1, memory_order_seq_cst);
+            futex_wake(&seq, 1);
+        }
+    }
+};
+
+// Cola de segmentos enlazados (estilo FAAArrayQueue): cada segmento es un
+// arreglo de SEG slots que productores y consumidores reparten con fetch_add.
+// Un consumidor que llega antes que su productor "envenena" el slot y el
+// productor reintenta en otro. Los segmentos vaciados se retiran con hazard
+// pointers y se reciclan en una caché acotada (anillo MPMC de Vyukov), así la
+// ruta caliente no llama a malloc.
+struct LfQueue {
+    static constexpr long SEG = 256;         // slots por segmento
+    static constexpr int  MAX_THREADS = 64;  // hilos distintos que pueden usarla
+    static constexpr long CACHE = 16;        // segmentos guardados para reciclar
+    static constexpr size_t RETIRE_SCAN = 8; // retirados antes de escanear HPs
+
+    struct Slot {
+        atomic<int> state{0}; // 0 vacío, 1 escrito, 2 consumido o envenenado
+        Item it;
+    };
+    struct Segment {
+        alignas(64) atomic<long> enq{0};
+        alignas(64) atomic<long> deq{0};
+        atomic<Segment*> next{nullptr};
+        long id = 0; // posición del segmento en la cola (para depth)
+        Slot slots[SEG];
+    };
+    // Un hazard pointer y una lista de retirados por hilo
+    struct alignas(64) HpRec {
+        atomic<Segment*> hp{nullptr};
+        vector<Segment*> retired;
+    };
+    struct CacheCell {
+        atomic<long> seq;
+        Segment* seg;
+    };
+
+    alignas(64) atomic<Segment*> head;
+    alignas(64) atomic<Segment*> tail;
+    alignas(64) atomic<long> cache_enq{0};
+    alignas(64) atomic<long> cache_deq{0};
+    CacheCell cache[CACHE];
+    HpRec rec[MAX_THREADS];
+    atomic<int> nrec{0};
+    atomic<long> seg_mallocs{0}; // segmentos que sí salieron de new
+    EventCount ev;
+    const unsigned long qid;     // distingue colas en la caché thread_local
+
+    LfQueue() : qid(next_qid()) {
+        for (long i = 0; i < CACHE; ++i) cache[i].seq.store(i, memory_order_relaxed);
+        Segment* s = new Segment;
+        seg_mallocs++;
+        head.store(s, memory_order_relaxed);
+        tail.store(s, memory_order_relaxed);
+    }
+
+    ~LfQueue() {
+        // Sin hilos activos: liberar cola viva, retirados y caché
+        for (Segment* s = head.load(); s; ) { Segment* n = s->next.load(); delete s; s = n; }
+        for (auto& r : rec) for (Segment* s : r.retired) delete s;
+        Segment* s;
+        while ((s = cache_pop())) delete s;
+    }
+
+    static unsigned long next_qid() {
+        static atomic<unsigned long> c{0};
+        return ++c;
+    }
+
+    // Registro del hilo actual en esta cola (una vez por hilo y cola)
+    HpRec& my_rec() {
+        // Sin desalojo: un hilo se registra como mucho una vez por cola, así
+        // que nunca gasta más de un rec en ella. qid no se reutiliza.
+        struct TlEntry { unsigned long qid; int idx; };
+        static thread_local vector<TlEntry> tl;
+        for (auto& e : tl) if (e.qid == qid) return rec[e.idx];
+        int idx = nrec.fetch_add(1);
+        if (idx >= MAX_THREADS) {
+            fprintf(stderr, "LfQueue: más de %d hilos\n", MAX_THREADS);
+            abort();
+        }
+        tl.push_back(TlEntry{qid, idx});
+        return rec[idx];
+    }
+
+    Segment* protect(atomic<Segment*>& src, HpRec& r) {
+        Segment* p = src.load(memory_order_acquire);
+        while (true) {
+            r.hp.store(p, memory_order_seq_cst);
+            Segment* q = src.load(memory_order_seq_cst);
+            if (q == p) return p;
+            p = q;
+        }
+    }
+
+    bool cache_push(Segment* s) {
+        long pos = cache_enq.load(memory_order_relaxed);
+        while (true) {
+            CacheCell& c = cache[pos % CACHE];
+            long dif = c.seq.load(memory_order_acquire) - pos;
+            if (dif == 0) {
+                if (cache_enq.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    c.seg = s;
+                    c.seq.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false; // llena
+            } else {
+                pos = cache_enq.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    Segment* cache_pop() {
+        long pos = cache_deq.load(memory_order_relaxed);
+        while (true) {
+            CacheCell& c = cache[pos % CACHE];
+            long dif = c.seq.load(memory_order_acquire) - (pos + 1);
+            if (dif == 0) {
+                if (cache_deq.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    Segment* s = c.seg;
+                    c.seq.store(pos + CACHE, memory_order_release);
+                    return s;
+                }
+            } else if (dif < 0) {
+                return nullptr; // vacía
+            } else {
+                pos = cache_deq.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    Segment* alloc_seg() {
+        if (Segment* s = cache_pop()) return s;
+        seg_mallocs.fetch_add(1, memory_order_relaxed);
+        return new Segment;
+    }
+
+    // Solo se llama cuando nadie más puede ver el segmento
+    void free_seg(Segment* s) {
+        s->enq.store(0, memory_order_relaxed);
+        s->deq.store(0, memory_order_relaxed);
+        s->next.store(nullptr, memory_order_relaxed);
+        for (auto& sl : s->slots) sl.state.store(0, memory_order_relaxed);
+        if (!cache_push(s)) delete s;
+    }
+
+    void retire(Segment* s, HpRec& r) {
+        r.retired.push_back(s);
+        if (r.retired.size() < RETIRE_SCAN) return;
+        const int n = min(nrec.load(memory_order_acquire), MAX_THREADS);
+        vector<Segment*> keep;
+        for (Segment* x : r.retired) {
+            bool used = false;
+            for (int i = 0; i < n && !used; ++i)
+                used = rec[i].hp.load(memory_order_seq_cst) == x;
+            if (used) keep.push_back(x);
+            else      free_seg(x);
+        }
+        r.retired.swap(keep);
+    }
+
+    void put(Item it) {
+        HpRec& r = my_rec();
+        while (true) {
+            Segment* lt = protect(tail, r);
+            long idx = lt->enq.fetch_add(1, memory_order_acq_rel);
+            if (idx >= SEG) {
+                // Segmento lleno: enlazar uno nuevo (ya con el elemento) o ayudar a avanzar tail
+                if (lt != tail.load(memory_order_acquire)) continue;
+                Segment* nx = lt->next.load(memory_order_acquire);
+                if (!nx) {
+                    Segment* ns = alloc_seg();
+                    ns->id = lt->id + 1;
+                    ns->slots[0].it = it;
+                    ns->slots[0].state.store(1, memory_order_relaxed);
+                    ns->enq.store(1, memory_order_relaxed);
+                    Segment* expected = nullptr;
+                    if (lt->next.compare_exchange_strong(expected, ns, memory_order_acq_rel)) {
+                        tail.compare_exchange_strong(lt, ns, memory_order_acq_rel);
+                        break;
+                    }
+                    free_seg(ns); // nunca se publicó
+                } else {
+                    tail.compare_exchange_strong(lt, nx, memory_order_acq_rel);
+                }
+                continue;
+            }
+            Slot& s = lt->slots[idx];
+            s.it = it;
+            int expected = 0;
+            if (s.state.compare_exchange_strong(expected, 1, memory_order_release,
+                                                memory_order_relaxed))
+                break;
+            // un consumidor envenenó el slot: pedir otro
+        }
+        r.hp.store(nullptr, memory_order_release);
+        ev.notify_one();
+    }
+
+    bool try_get(Item& out) {
+        HpRec& r = my_rec();
+        bool ok = false;
+        while (true) {
+            Segment* lh = protect(head, r);
+            if (lh->deq.load(memory_order_acquire) >= lh->enq.load(memory_order_acquire) &&
+                lh->next.load(memory_order_acquire) == nullptr)
+                break; // vacía
+            long idx = lh->deq.fetch_add(1, memory_order_acq_rel);
+            if (idx >= SEG) {
+                Segment* nx = lh->next.load(memory_order_acquire);
+                if (!nx) break;
+                // tail no puede quedarse apuntando a un segmento retirado
+                Segment* lt = lh;
+                tail.compare_exchange_strong(lt, nx, memory_order_acq_rel);
+                Segment* e = lh;
+                if (head.compare_exchange_strong(e, nx, memory_order_acq_rel)) {
+                    r.hp.store(nullptr, memory_order_release);
+                    retire(lh, r);
+                }
+                continue;
+            }
+            Slot& s = lh->slots[idx];
+            if (s.state.exchange(2, memory_order_acq_rel) == 1) {
+                out = s.it;
+                ok = true;
+                break;
+            }
+        }
+        r.hp.store(nullptr, memory_order_release);
+        return ok;
+    }
+
+    // Ocupación aproximada (lecturas no atómicas entre sí)
+    size_t depth() {
+        HpRec& r = my_rec();
+        Segment* h = protect(head, r);
+        long hpos = h->id * SEG + min(h->deq.load(memory_order_relaxed), SEG);
+        Segment* t = protect(tail, r);
+        long tpos = t->id * SEG + min(t->enq.load(memory_order_relaxed), SEG);
+        r.hp.store(nullptr, memory_order_release);
+        return tpos > hpos ? (size_t)(tpos - hpos) : 0;
+    }
+};
+
+void put(LfQueue* q, Item it, long* /*waited_ns*/ = nullptr) {
+    q->put(it); // nunca se bloquea
+}
+
+Item get(LfQueue* q, long* waited_ns = nullptr) {
+    Item it;
+    if (q->try_get(it)) return it;
+    long t0 = now_ns();
+    while (true) {
+        int key = q->ev.prepare_wait();
+        if (q->try_get(it)) { q->ev.cancel_wait(); break; }
+        q->ev.commit_wait(key);
+        if (q->try_get(it)) break;
+    }
+    if (waited_ns) *waited_ns += now_ns() - t0;
+    return it;
+}
+
+// Canal genérico: la etapa no sabe si habla con un hilo o con otro proceso
+struct Chan {
+    Buffer*  mem = nullptr;
+    ShmRing* shm = nullptr;
+    LfQueue* lf  = nullptr;
+};
+
+void put(Chan* c, Item it, long* waited_ns = nullptr) {
+    if (c->shm)     put(c->shm, it, waited_ns);
+    else if (c->lf) put(c->lf, it, waited_ns);
+    else            put(c->mem, it, waited_ns);
+}
+
+Item get(Chan* c, long* waited_ns = nullptr) {
+    if (c->shm) return get(c->shm, waited_ns);
+    if (c->lf)  return get(c->lf, waited_ns);
+    return get(c->mem, waited_ns);
+}
+
+// Ocupación actual del canal (la lee el muestreador)
+size_t depth(Chan* c) {
+    size_t d;
+    if (c->lf) {
+        d = c->lf->depth();
+    } else if (c->shm) {
+        // Sin tomar el mutex: un hijo muerto podría haberlo dejado tomado
+        d = __atomic_load_n(&c->shm->count, __ATOMIC_RELAXED);
+    } else {
+        pthread_mutex_lock(&c->mem->mtx);
+        d = c->mem->q.size();
+        pthread_mutex_unlock(&c->mem->mtx);
+    }
+    return d;
 }
 
 // ===== Etapas del pipeline =====
 
+static const char* const STAGE_NAMES[4] = {"producer", "stage1", "stage2", "consumer"};
+
+// Contabilidad de una etapa (ns): busy = life - starved - backpressured
+struct StageStats {
+    long items;
+    long life_ns;
+    long starved_ns;  // bloqueada en get() esperando not_empty
+    long blocked_ns;  // bloqueada en put() esperando not_full
+};
+
+// Ocupación de b1/b2/b3 según el muestreador
+struct DepthStats {
+    long samples;
+    double avg[3];
+    size_t max[3];
+    double full_pct[3];
+    double empty_pct[3];
+};
+
+// Métricas de una corrida (en modo proc vive en memoria compartida)
+struct Stats {
+    long items;
+    double lat_avg_us;
+    double lat_p50_us;
+    double lat_p99_us;
+    double lat_max_us;
+    StageStats stage[4];
+    DepthStats depth;
+};
+
+// Resume latencias (ns) en percentiles (us)
+static void fill_stats(vector<long>& lat, Stats* st) {
+    st->items = (long)lat.size();
+    st->lat_avg_us = st->lat_p50_us = st->lat_p99_us = st->lat_max_us = 0.0;
+    if (lat.empty()) return;
+    sort(lat.begin(), lat.end());
+    double sum = 0.0;
+    for (long v : lat) sum += v;
+    st->lat_avg_us = sum / lat.size() / 1000.0;
+    st->lat_p50_us = lat[lat.size() / 2] / 1000.0;
+    st->lat_p99_us = lat[(lat.size() * 99) / 100] / 1000.0;
+    st->lat_max_us = lat.back() / 1000.0;
+}
+
 struct Args {
-    Buffer* in;
-    Buffer* out;
+    Chan* in;
+    Chan* out;
     long n;
+    int pause_us;   // trabajo simulado por elemento en el consumidor
+    Stats* st;      // solo lo usa el consumidor
+    StageStats* ss; // contabilidad de esta etapa
 };
 
 // Generador
 void* producer(void* arg) {
     Args* a = (Args*)arg;
-    for (long i = 1; i <= a->n; i++)
-        put(a->out, i);
-    put(a->out, -1); // fin
+    StageStats* ss = a->ss;
+    long t0 = now_ns();
+    for (long i = 1; i <= a->n; i++) {
+        put(a->out, Item{i, now_ns()}, &ss->blocked_ns);
+        ss->items++;
+    }
+    put(a->out, Item{-1, 0}, &ss->blocked_ns); // fin
+    ss->life_ns = now_ns() - t0;
     return nullptr;
 }
 
 // Multiplica por 2
 void* stage1(void* arg) {
     Args* a = (Args*)arg;
+    StageStats* ss = a->ss;
+    long t0 = now_ns();
     while (true) {
-        long x = get(a->in);
-        if (x < 0) { put(a->out, -1); break; }
-        put(a->out, x * 2);
+        Item x = get(a->in, &ss->starved_ns);
+        if (x.val < 0) { put(a->out, x, &ss->blocked_ns); break; }
+        put(a->out, Item{x.val * 2, x.t_ns}, &ss->blocked_ns);
+        ss->items++;
     }
+    ss->life_ns = now_ns() - t0;
     return nullptr;
 }
 
 // Suma 3
 void* stage2(void* arg) {
     Args* a = (Args*)arg;
+    StageStats* ss = a->ss;
+    long t0 = now_ns();
     while (true) {
-        long x = get(a->in);
-        if (x < 0) { put(a->out, -1); break; }
-        put(a->out, x + 3);
+        Item x = get(a->in, &ss->starved_ns);
+        if (x.val < 0) { put(a->out, x, &ss->blocked_ns); break; }
+        put(a->out, Item{x.val + 3, x.t_ns}, &ss->blocked_ns);
+        ss->items++;
     }
+    ss->life_ns = now_ns() - t0;
     return nullptr;
 }
 
 // Consumidor final
 void* consumer(void* arg) {
     Args* a = (Args*)arg;
+    StageStats* ss = a->ss;
+    vector<long> lat;
+    lat.reserve(a->n);
+    long t0 = now_ns();
     while (true) {
-        long x = get(a->in);
-        if (x < 0) break;
+        Item x = get(a->in, &ss->starved_ns);
+        if (x.val < 0) break;
+        lat.push_back(now_ns() - x.t_ns);
         // Simular trabajo
+        if (a->pause_us > 0) usleep(a->pause_us);
+        ss->items++;
+    }
+    ss->life_ns = now_ns() - t0;
+
+    fill_stats(lat, a->st);
+    return nullptr;
+}
+
+// ===== Muestreador de ocupación =====
+
+// Hilo de fondo que cada period_us lee la ocupación de los 3 canales
+struct Sampler {
+    Chan* c;
+    size_t cap;
+    int period_us;
+    atomic<bool> stop{false};
+    vector<array<size_t, 3>> samples;
+    pthread_t th;
+    bool running = false;
+};
+
+static void* sampler_main(void* p) {
+    auto* sm = static_cast<Sampler*>(p);
+    while (!sm->stop.load(memory_order_acquire)) {
+        sm->samples.push_back({depth(&sm->c[0]), depth(&sm->c[1]), depth(&sm->c[2])});
+        usleep(sm->period_us);
     }
     return nullptr;
 }
 
+static void sampler_start(Sampler& sm, Chan c[3], size_t cap) {
+    sm.c = c;
+    sm.cap = cap;
+    sm.period_us = 1000;
+    sm.samples.reserve(4096);
+    sm.running = pthread_create(&sm.th, nullptr, sampler_main, &sm) == 0;
+}
+
+static void sampler_stop(Sampler& sm, DepthStats& ds) {
+    sm.stop.store(true, memory_order_release);
+    if (sm.running) pthread_join(sm.th, nullptr);
+    sm.running = false;
+
+    ds = DepthStats{};
+    ds.samples = (long)sm.samples.size();
+    if (sm.samples.empty()) return;
+    for (auto& smp : sm.samples) {
+        for (int i = 0; i < 3; ++i) {
+            ds.avg[i] += smp[i];
+            ds.max[i] = max(ds.max[i], smp[i]);
+            if (smp[i] >= sm.cap) ds.full_pct[i] += 1;
+            if (smp[i] == 0)      ds.empty_pct[i] += 1;
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        ds.avg[i] /= ds.samples;
+        ds.full_pct[i]  *= 100.0 / ds.samples;
+        ds.empty_pct[i] *= 100.0 / ds.samples;
+    }
+}
+
+// ===== Modos de ejecución =====
+
+static void* (*const STAGES[4])(void*) = {producer, stage1, stage2, consumer};
+
+// Cablea las 4 etapas sobre los canales c[0..2]
+static void wire(Args args[4], Chan c[3], long N, int pause_us, Stats* st) {
+    args[0] = Args{nullptr, &c[0], N, pause_us, st, &st->stage[0]};
+    args[1] = Args{&c[0],   &c[1], N, pause_us, st, &st->stage[1]};
+    args[2] = Args{&c[1],   &c[2], N, pause_us, st, &st->stage[2]};
+    args[3] = Args{&c[2],   nullptr, N, pause_us, st, &st->stage[3]};
+}
+
+// Todas las etapas como hilos de este proceso, unidas por Buffer (o LfQueue)
+static bool run_threads(long N, size_t buf, int pause_us, bool lockfree, double& ms, Stats& st) {
+    // Solo se construye el tipo de canal que se usa (LfQueue no es pequeña)
+    unique_ptr<Buffer[]>  b;
+    unique_ptr<LfQueue[]> q;
+    Chan c[3];
+    if (lockfree) q.reset(new LfQueue[3]);
+    else          b.reset(new Buffer[3]);
+    for (int i = 0; i < 3; ++i) {
+        if (lockfree) {
+            c[i].lf = &q[i];
+        } else {
+            b[i].max_size = buf;
+            c[i].mem = &b[i];
+        }
+    }
+
+    Args args[4];
+    wire(args, c, N, pause_us, &st);
+
+    Sampler sm;
+    pthread_t th[4];
+    long t0 = now_ns();
+    sampler_start(sm, c, buf);
+    for (int i = 0; i < 4; ++i) pthread_create(&th[i], nullptr, STAGES[i], &args[i]);
+    for (int i = 0; i < 4; ++i) pthread_join(th[i], nullptr);
+    ms = (now_ns() - t0) / 1e6;
+    sampler_stop(sm, st.depth);
+    return true;
+}
+
+// Cosecha a los n hijos en el orden en que terminen. Si uno muere de forma
+// anormal se mata al resto: sus vecinos quedarían bloqueados para siempre en
+// un anillo sin contraparte. pid[i] = -1 marca a los ya cosechados.
+static bool reap_children(pid_t pid[], int n) {
+    bool ok = true;
+    int alive = n;
+    while (alive > 0) {
+        int status = 0;
+        pid_t w = waitpid(-1, &status, 0);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            perror("waitpid");
+            return false;
+        }
+        int idx = -1;
+        for (int i = 0; i < n; ++i) if (pid[i] == w) idx = i;
+        if (idx < 0) continue;
+        pid[idx] = -1;
+        alive--;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) continue;
+        if (ok) {
+            cerr << "Etapa " << STAGE_NAMES[idx] << " terminó de forma anormal\n";
+            for (int i = 0; i < n; ++i) if (pid[i] > 0) kill(pid[i], SIGKILL);
+        }
+        ok = false;
+    }
+    return ok;
+}
+
+// Cada etapa en un proceso hijo (fork), unidas por ShmRing en memoria compartida
+static bool run_procs(long N, size_t buf, int pause_us, double& ms, Stats& st) {
+    ShmRing* r[3] = {nullptr, nullptr, nullptr};
+    Stats* sst = nullptr;
+    Chan c[3];
+    bool ok = true;
+
+    for (int i = 0; i < 3 && ok; ++i) {
+        r[i] = static_cast<ShmRing*>(shm_alloc(shm_ring_bytes(buf)));
+        if (!r[i]) { ok = false; break; }
+        shm_ring_init(r[i], buf);
+        c[i].shm = r[i];
+    }
+    if (ok) {
+        sst = static_cast<Stats*>(shm_alloc(sizeof(Stats))); // memfd nace en ceros
+        if (!sst) ok = false;
+    }
+
+    if (ok) {
+        Args args[4];
+        wire(args, c, N, pause_us, sst);
+
+        fflush(stdout);
+        cout.flush();
+
+        pid_t pid[4];
+        int forked = 0;
+        long t0 = now_ns();
+        // fork() desde un padre de un solo hilo: el muestreador arranca después
+        for (int i = 0; i < 4; ++i) {
+            pid[i] = fork();
+            if (pid[i] < 0) { perror("fork"); ok = false; break; }
+            if (pid[i] == 0) {
+                STAGES[i](&args[i]);
+                _exit(0);
+            }
+            forked++;
+        }
+        // Si falló un fork, los hijos ya creados esperan etapas que no existen
+        if (!ok)
+            for (int i = 0; i < forked; ++i) kill(pid[i], SIGKILL);
+
+        // El muestreador corre en el padre: los anillos también están mapeados aquí
+        Sampler sm;
+        if (ok) sampler_start(sm, c, buf);
+        if (!reap_children(pid, forked)) ok = false;
+        ms = (now_ns() - t0) / 1e6;
+        sampler_stop(sm, sst->depth); // no-op si nunca arrancó
+
+        if (ok) st = *sst;
+    }
+
+    if (sst) munmap(sst, sizeof(Stats));
+    for (int i = 0; i < 3; ++i) {
+        if (!r[i]) continue;
+        // Si un hijo murió a la mitad, el mutex/condvar pueden tener dueños o
+        // esperas que nunca se resolverán (pthread_cond_destroy se quedaría
+        // esperándolas): en ese caso solo se desmapea
+        if (ok) shm_ring_destroy(r[i]);
+        munmap(r[i], shm_ring_bytes(buf));
+    }
+    return ok;
+}
+
+// Sin etapas ni canales: bloques de `buf` elementos pasan completos por
+// stage1 -> stage2 -> consumidor dentro de un worker del pool work-stealing.
+// La latencia se mide desde que el bloque empieza hasta que sale cada elemento
+// (se reporta como "lat(bloque)", no es la latencia de cola de los otros modos).
+static bool run_batch(long N, size_t buf, int pause_us, int workers, double& ms, Stats& st) {
+    WsPool pool(workers);
+    vector<vector<long>> lat(pool.size());
+    for (auto& v : lat) v.reserve(N / pool.size() + buf);
+
+    long t0 = now_ns();
+    pool.parallel_for(1, N + 1, (long)buf, [&](long lo, long hi, int w) {
+        long t_blk = now_ns();
+        for (long i = lo; i < hi; ++i) {
+            volatile long x = i * 2 + 3;
+            (void)x;
+            lat[w].push_back(now_ns() - t_blk);
+            if (pause_us > 0) usleep(pause_us);
+        }
+    });
+    ms = (now_ns() - t0) / 1e6;
+
+    vector<long> all;
+    all.reserve(N);
+    for (auto& v : lat) all.insert(all.end(), v.begin(), v.end());
+    fill_stats(all, &st);
+    return true;
+}
+
+// ===== Benchmark MPMC: un canal, P productores y C consumidores =====
+
+struct MpmcArgs {
+    Chan* c;
+    long from, to;     // productor: valores [from, to)
+    vector<long>* lat; // consumidor: latencias
+};
+
+static void* mpmc_producer(void* p) {
+    auto* a = static_cast<MpmcArgs*>(p);
+    for (long i = a->from; i < a->to; ++i) put(a->c, Item{i, now_ns()});
+    return nullptr;
+}
+
+static void* mpmc_consumer(void* p) {
+    auto* a = static_cast<MpmcArgs*>(p);
+    while (true) {
+        Item x = get(a->c);
+        if (x.val < 0) break;
+        a->lat->push_back(now_ns() - x.t_ns);
+    }
+    return nullptr;
+}
+
+// Reparte N elementos entre P productores; al terminar estos se mete un
+// centinela por consumidor
+static void run_mpmc(Chan* c, long N, int P, int C, double& ms, Stats& st) {
+    vector<vector<long>> lat(C);
+    vector<MpmcArgs> pa(P), ca(C);
+    vector<pthread_t> pt(P), ct(C);
+
+    long t0 = now_ns();
+    for (int i = 0; i < C; ++i) {
+        ca[i] = MpmcArgs{c, 0, 0, &lat[i]};
+        pthread_create(&ct[i], nullptr, mpmc_consumer, &ca[i]);
+    }
+    for (int i = 0; i < P; ++i) {
+        pa[i] = MpmcArgs{c, 1 + N * i / P, 1 + N * (i + 1) / P, nullptr};
+        pthread_create(&pt[i], nullptr, mpmc_producer, &pa[i]);
+    }
+    for (int i = 0; i < P; ++i) pthread_join(pt[i], nullptr);
+    for (int i = 0; i < C; ++i) put(c, Item{-1, 0});
+    for (int i = 0; i < C; ++i) pthread_join(ct[i], nullptr);
+    ms = (now_ns() - t0) / 1e6;
+
+    vector<long> all;
+    all.reserve(N);
+    for (auto& v : lat) all.insert(all.end(), v.begin(), v.end());
+    fill_stats(all, &st);
+}
+
+// `lat` nombra la latencia: en los modos con canales va de put() a la salida,
+// en batch desde que empieza el bloque, y no son comparables entre sí.
+static void report(const char* tag, double ms, const Stats& st, const char* lat = "lat") {
+    double ips = ms > 0 ? st.items / (ms / 1000.0) : 0.0;
+    cout << fixed << setprecision(2)
+         << tag << " tiempo=" << ms << " ms"
+         << "  items/s=" << setprecision(0) << ips << setprecision(2)
+         << "  " << lat << " avg=" << st.lat_avg_us << " us"
+         << "  p50=" << st.lat_p50_us << " us"
+         << "  p99=" << st.lat_p99_us << " us"
+         << "  max=" << st.lat_max_us << " us\n";
+}
+
+// Tabla de utilización por etapa y ocupación de buffers.
+// Con buffers acotados el cuello de botella es la etapa con mayor fracción
+// ocupada: las de antes quedan frenadas por backpressure y las de después se
+// quedan sin datos. Con canales no acotados (lock-free) put() nunca frena, así
+// que el productor siempre aparece 100% ocupado; ahí el cuello es la etapa
+// cuya cola de entrada más crece, o el productor si nada se acumula.
+static void report_stages(const Stats& st, size_t buf, bool bounded) {
+    cout << fixed << setprecision(1)
+         << "  etapa       items     busy%  starved%  backpres%\n";
+    int bottleneck = 0;
+    double best = -1.0;
+    for (int i = 0; i < 4; ++i) {
+        const StageStats& ss = st.stage[i];
+        double life = ss.life_ns > 0 ? (double)ss.life_ns : 1.0;
+        double busy = 100.0 * (ss.life_ns - ss.starved_ns - ss.blocked_ns) / life;
+        cout << "  " << left << setw(10) << STAGE_NAMES[i] << right
+             << setw(7) << ss.items
+             << setw(10) << busy
+             << setw(10) << 100.0 * ss.starved_ns / life
+             << setw(11) << 100.0 * ss.blocked_ns / life << "\n";
+        if (busy > best) { best = busy; bottleneck = i; }
+    }
+
+    const DepthStats& ds = st.depth;
+    if (bounded) {
+        cout << "  buffer    cap      prom     max  lleno%  vacío%   (" << ds.samples << " muestras)\n";
+        for (int i = 0; i < 3; ++i) {
+            cout << "  b" << (i + 1) << "    " << setw(7) << buf
+                 << setw(10) << ds.avg[i]
+                 << setw(8) << ds.max[i]
+                 << setw(8) << ds.full_pct[i]
+                 << setw(8) << ds.empty_pct[i] << "\n";
+        }
+        cout << "  Cuello de botella: " << STAGE_NAMES[bottleneck]
+             << " (busy " << best << "%)\n" << setprecision(2);
+        return;
+    }
+
+    cout << "  cola        prom     max  vacío%   (" << ds.samples << " muestras, sin cap)\n";
+    int grow = -1;
+    for (int i = 0; i < 3; ++i) {
+        cout << "  b" << (i + 1) << "    "
+             << setw(10) << ds.avg[i]
+             << setw(8) << ds.max[i]
+             << setw(8) << ds.empty_pct[i] << "\n";
+        if (ds.avg[i] >= 1.0 && (grow < 0 || ds.avg[i] > ds.avg[grow])) grow = i;
+    }
+    if (grow >= 0) {
+        const StageStats& ss = st.stage[grow + 1];
+        double life = ss.life_ns > 0 ? (double)ss.life_ns : 1.0;
+        cout << "  Cuello de botella: " << STAGE_NAMES[grow + 1]
+             << " (cola b" << (grow + 1) << " prom " << ds.avg[grow]
+             << ", starved " << 100.0 * ss.starved_ns / life << "%)\n" << setprecision(2);
+    } else {
+        cout << "  Cuello de botella: producer (ninguna cola se acumula)\n" << setprecision(2);
+    }
+}
+
 int main(int argc, char* argv[]) {
     if (argc < 2) {
-        cerr << "Uso: " << argv[0] << " N\n";
+        cerr << "Uso: " << argv[0] << " N [buffer] [pause_us]"
+                " [thread|proc|both|batch|lockfree|mpmc] [workers|productores] [consumidores]\n";
         return 1;
     }
     long N = atol(argv[1]);
+    int buf = (argc > 2) ? arg_to_int_or(argv[2], 8) : 8;
+    int pause_us = (argc > 3) ? arg_to_int_or(argv[3], 0) : 0;
+    const string mode = (argc > 4) ? argv[4] : "thread";
+    int workers = (argc > 5) ? arg_to_int_or(argv[5], 4) : 4; // batch; productores en mpmc
+    int consumers = (argc > 6) ? arg_to_int_or(argv[6], workers) : workers; // solo mpmc
+
+    if (N <= 0 || buf <= 0 || pause_us < 0 || workers <= 0 || consumers <= 0) {
+        cerr << "Parámetros inválidos.\n";
+        return 1;
+    }
+    if (mode != "thread" && mode != "proc" && mode != "both" && mode != "batch" &&
+        mode != "lockfree" && mode != "mpmc") {
+        cerr << "Modo desconocido: " << mode
+             << " (thread | proc | both | batch | lockfree | mpmc)\n";
+        return 1;
+    }
+    // Cada hilo que toca la LfQueue ocupa un hazard pointer: P + C + main
+    if (mode == "mpmc" && workers + consumers + 1 > LfQueue::MAX_THREADS) {
+        cerr << "mpmc: productores + consumidores debe ser <= "
+             << LfQueue::MAX_THREADS - 1 << " (límite de hazard pointers de LfQueue)\n";
+        return 1;
+    }
 
-    Buffer b1, b2, b3;
-    pthread_t p, s1, s2, c;
+    cout << "N=" << N << "  buffer=" << buf << "  pause_us=" << pause_us
+         << "  mode=" << mode << "\n";
 
-    Args Aprod {nullptr, &b1, N};
-    Args A1 {&b1, &b2, N};
-    Args A2 {&b2, &b3, N};
-    Args Acons {&b3, nullptr, N};
+    double ms_thr = 0, ms_proc = 0;
+    Stats st_thr{}, st_proc{};
 
-    pthread_create(&p, nullptr, producer, &Aprod);
-    pthread_create(&s1, nullptr, stage1, &A1);
-    pthread_create(&s2, nullptr, stage2, &A2);
-    pthread_create(&c, nullptr, consumer, &Acons);
+    if (mode == "batch") {
+        double ms_b = 0;
+        Stats st_b{};
+        run_batch(N, (size_t)buf, pause_us, workers, ms_b, st_b);
+        report("[BATCH] ", ms_b, st_b, "lat(bloque)");
+        cout << "Pipeline terminado con N=" << N << endl;
+        return 0;
+    }
+
+    if (mode == "mpmc") {
+        // Mismo tráfico sobre el Buffer con mutex (acotado) y sobre LfQueue
+        cout << "productores=" << workers << "  consumidores=" << consumers << "\n";
+        Buffer b;
+        b.max_size = (size_t)buf;
+        LfQueue q;
+        Chan cb, cq;
+        cb.mem = &b;
+        cq.lf = &q;
+        double ms_b = 0, ms_q = 0;
+        Stats st_b{}, st_q{};
+        run_mpmc(&cb, N, workers, consumers, ms_b, st_b);
+        report("[MUTEX] ", ms_b, st_b);
+        run_mpmc(&cq, N, workers, consumers, ms_q, st_q);
+        report("[LOCKFREE]", ms_q, st_q);
+        cout << "  segmentos nuevos=" << q.seg_mallocs.load()
+             << " (de " << (N + LfQueue::SEG - 1) / LfQueue::SEG << " usados)\n";
+        if (ms_q > 0)
+            cout << fixed << setprecision(2) << "Lock-free vs mutex: throughput x" << ms_b / ms_q << "\n";
+        cout << "Pipeline terminado con N=" << N << endl;
+        return 0;
+    }
 
-    pthread_join(p, nullptr);
-    pthread_join(s1, nullptr);
-    pthread_join(s2, nullptr);
-    pthread_join(c, nullptr);
+    if (mode == "lockfree") {
+        run_threads(N, (size_t)buf, pause_us, true, ms_thr, st_thr);
+        report("[LOCKFREE]", ms_thr, st_thr);
+        report_stages(st_thr, (size_t)buf, false);
+        cout << "Pipeline terminado con N=" << N << endl;
+        return 0;
+    }
+
+    if (mode != "proc") {
+        run_threads(N, (size_t)buf, pause_us, false, ms_thr, st_thr);
+        report("[THREAD]", ms_thr, st_thr);
+        report_stages(st_thr, (size_t)buf, true);
+    }
+    if (mode != "thread") {
+        if (!run_procs(N, (size_t)buf, pause_us, ms_proc, st_proc)) {
+            cerr << "Fallo en el modo proc\n";
+            return 1;
+        }
+        report("[PROC]  ", ms_proc, st_proc);
+        report_stages(st_proc, (size_t)buf, true);
+    }
+    if (mode == "both" && ms_proc > 0 && st_thr.lat_p50_us > 0) {
+        cout << fixed << setprecision(2)
+             << "Costo de aislamiento: throughput x" << ms_thr / ms_proc
+             << "  lat p50 x" << st_proc.lat_p50_us / st_thr.lat_p50_us
+             << "  lat p99 x" << st_proc.lat_p99_us / st_thr.lat_p99_us << "\n";
+    }
 
     cout << "Pipeline terminado con N=" << N << endl;
     return 0;
@@ -1,4 +1,11 @@
 #include "utils.h"
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -20,3 +27,214 @@ int arg_to_int_or(const char* s, int fallback) {
 std::vector<int> make_vec(int n, int v) {
     return std::vector<int>(n, v);
 }
+
+void futex_wait(std::atomic<int>* addr, int expected) {
+    syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAIT_PRIVATE, expected,
+            nullptr, nullptr, 0);
+}
+
+void futex_wake(std::atomic<int>* addr, int n) {
+    syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAKE_PRIVATE, n,
+            nullptr, nullptr, 0);
+}
+
+// ===== Planificador work-stealing =====
+
+namespace {
+
+// Rango pendiente [lo, hi)
+struct WsTask {
+    long lo, hi;
+};
+
+// Deque Chase-Lev de capacidad fija (versión C11 de Lê et al.). El dueño hace
+// push/pop por abajo; los ladrones roban por arriba con un CAS sobre top.
+// Si está lleno, push falla y el dueño simplemente no divide más.
+// Los rangos se guardan por valor en la ranura (dos atómicos): el ladrón los
+// lee antes del CAS, y si el dueño llegó a pisar la ranura es porque top ya
+// avanzó, así que el CAS falla y la lectura se descarta.
+struct WsDeque {
+    static constexpr long CAP = 1024; // potencia de 2
+    struct Slot { std::atomic<long> lo{0}, hi{0}; };
+    alignas(64) std::atomic<long> top{0};
+    alignas(64) std::atomic<long> bottom{0};
+    Slot buf[CAP];
+
+    bool push(WsTask t) {
+        long b = bottom.load(std::memory_order_relaxed);
+        long tp = top.load(std::memory_order_acquire);
+        if (b - tp >= CAP) return false;
+        Slot& sl = buf[b & (CAP - 1)];
+        sl.lo.store(t.lo, std::memory_order_relaxed);
+        sl.hi.store(t.hi, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool pop(WsTask& out) {
+        long b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long tp = top.load(std::memory_order_relaxed);
+        if (tp > b) { // vacío
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        Slot& sl = buf[b & (CAP - 1)];
+        out = WsTask{sl.lo.load(std::memory_order_relaxed), sl.hi.load(std::memory_order_relaxed)};
+        bool ok = true;
+        if (tp == b) { // último elemento: competir con los ladrones
+            ok = top.compare_exchange_strong(tp, tp + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return ok;
+    }
+
+    bool steal(WsTask& out) {
+        long tp = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long b = bottom.load(std::memory_order_acquire);
+        if (tp >= b) return false;
+        Slot& sl = buf[tp & (CAP - 1)];
+        WsTask x{sl.lo.load(std::memory_order_relaxed), sl.hi.load(std::memory_order_relaxed)};
+        if (!top.compare_exchange_strong(tp, tp + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed))
+            return false; // otro ladrón (o el dueño) ganó
+        out = x;
+        return true;
+    }
+};
+
+// Estado por worker: su deque (los rangos viajan por valor, sin memoria extra)
+struct WsWorker {
+    WsDeque dq;
+    unsigned rng = 0;
+    pthread_t th{};
+};
+
+} // namespace
+
+struct WsState {
+    int n = 0;
+    std::vector<WsWorker*> w;
+
+    // Trabajo actual
+    const std::function<void(long, long, int)>* body = nullptr;
+    long grain = 1;
+    std::atomic<long> pending{0}; // elementos aún sin procesar
+    std::atomic<int>  active{0};  // workers de fondo dentro del trabajo
+
+    // Despertar de los workers de fondo
+    pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t  cv  = PTHREAD_COND_INITIALIZER;
+    long gen = 0;
+    bool stop = false;
+};
+
+struct WsBoot {
+    WsState* s;
+    int id;
+};
+
+// Procesa un rango: mientras sea más grande que grain, publica la mitad
+// superior para que otro la robe y sigue con la inferior.
+static void ws_run(WsState* s, int id, WsTask t) {
+    WsWorker* me = s->w[id];
+    while (t.hi - t.lo > s->grain) {
+        long mid = t.lo + (t.hi - t.lo) / 2;
+        if (!me->dq.push(WsTask{mid, t.hi})) break;
+        t.hi = mid;
+    }
+    for (long lo = t.lo; lo < t.hi; lo += s->grain)
+        (*s->body)(lo, std::min(lo + s->grain, t.hi), id);
+    s->pending.fetch_sub(t.hi - t.lo, std::memory_order_acq_rel);
+}
+
+static void ws_work(WsState* s, int id) {
+    WsWorker* me = s->w[id];
+    while (s->pending.load(std::memory_order_acquire) > 0) {
+        WsTask t;
+        bool got = me->dq.pop(t);
+        if (!got && s->n > 1) {
+            // Víctima pseudoaleatoria (xorshift) para no robar siempre al mismo
+            me->rng ^= me->rng << 13; me->rng ^= me->rng >> 17; me->rng ^= me->rng << 5;
+            int v = (int)(me->rng % (unsigned)s->n);
+            if (v != id) got = s->w[v]->dq.steal(t);
+        }
+        if (got) ws_run(s, id, t);
+        else   sched_yield();
+    }
+}
+
+static void* ws_thread(void* p) {
+    auto* b = static_cast<WsBoot*>(p);
+    WsState* s = b->s;
+    const int id = b->id;
+    delete b;
+
+    long seen = 0;
+    while (true) {
+        pthread_mutex_lock(&s->mtx);
+        while (s->gen == seen && !s->stop)
+            pthread_cond_wait(&s->cv, &s->mtx);
+        if (s->stop) { pthread_mutex_unlock(&s->mtx); break; }
+        seen = s->gen;
+        pthread_mutex_unlock(&s->mtx);
+
+        ws_work(s, id);
+        s->active.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    return nullptr;
+}
+
+WsPool::WsPool(int workers) : st_(new WsState) {
+    st_->n = workers > 0 ? workers : 1;
+    for (int i = 0; i < st_->n; ++i) {
+        st_->w.push_back(new WsWorker);
+        st_->w[i]->rng = 2654435761u * (unsigned)(i + 1);
+    }
+    for (int i = 1; i < st_->n; ++i)
+        pthread_create(&st_->w[i]->th, nullptr, ws_thread, new WsBoot{st_, i});
+}
+
+WsPool::~WsPool() {
+    pthread_mutex_lock(&st_->mtx);
+    st_->stop = true;
+    pthread_cond_broadcast(&st_->cv);
+    pthread_mutex_unlock(&st_->mtx);
+    for (int i = 1; i < st_->n; ++i) pthread_join(st_->w[i]->th, nullptr);
+    for (auto* w : st_->w) delete w;
+    delete st_;
+}
+
+int WsPool::size() const { return st_->n; }
+
+void WsPool::parallel_for(long begin, long end, long grain,
+                          const std::function<void(long, long, int)>& body) {
+    if (end <= begin) return;
+    WsState* s = st_;
+
+    // Nadie está dentro de un trabajo: se pueden reiniciar los deques
+    for (auto* w : s->w) {
+        w->dq.top.store(0, std::memory_order_relaxed);
+        w->dq.bottom.store(0, std::memory_order_relaxed);
+    }
+    s->body = &body;
+    s->grain = grain > 0 ? grain : 1;
+    s->pending.store(end - begin, std::memory_order_relaxed);
+
+    pthread_mutex_lock(&s->mtx);
+    s->active.store(s->n - 1, std::memory_order_relaxed);
+    s->gen++;
+    pthread_cond_broadcast(&s->cv);
+    pthread_mutex_unlock(&s->mtx);
+
+    // El llamador arranca con el rango completo y los demás le roban
+    ws_run(s, 0, WsTask{begin, end});
+    ws_work(s, 0);
+
+    // Esperar a que los workers de fondo suelten el trabajo
+    while (s->active.load(std::memory_order_acquire) != 0) sched_yield();
+}